@@ -0,0 +1,293 @@
+// A multi-channel DMA controller, attached with
+//   spike --extlib=libcustomext.so --device=dma[,<bytes per tick>]
+//
+// Each channel copies memory as described by a ring of descriptors that
+// software fills in memory.  The controller's memory traffic carries its
+// source ID and is checked against the IOPMP, so IOPMP configurations can
+// be exercised by real bus-master traffic.
+//
+// Registers of channel c, at base + c * DMA_CHANNEL_STRIDE (64-bit access):
+//   RING_BASE  physical address of the descriptor ring
+//   RING_SIZE  number of descriptors in the ring
+//   HEAD       index of the next descriptor software will fill
+//   TAIL       index of the next descriptor the channel will process (read-only)
+//   CTRL       DMA_CTRL_ENABLE, DMA_CTRL_IRQ_ENABLE
+//   STATUS     DMA_STATUS_DONE, DMA_STATUS_ERROR; write 1 to clear
+//
+// A descriptor is four 64-bit words: source, destination, length and
+// flags.  The channel sets DMA_DESC_DONE in the flags once it has finished
+// with the descriptor, and DMA_DESC_ERROR too if the IOPMP or the bus
+// refused part of the copy.  If DMA_DESC_IRQ is set in the flags, the
+// channel sets DMA_STATUS_DONE on completion.  The channel interrupt is
+// raised while CTRL.IRQ_ENABLE and any STATUS bit are set.
+
+#include "abstract_device.h"
+#include "abstract_interrupt_controller.h"
+#include "checkpoint.h"
+#include "dts.h"
+#include "libfdt.h"
+#include "mmu.h"
+#include "sim.h"
+#include <algorithm>
+#include <sstream>
+
+#define DMA_BASE              0x10010000
+#define DMA_INTERRUPT_ID      2
+#define DMA_CHANNELS          4
+#define DMA_CHANNEL_STRIDE    0x40
+#define DMA_SIZE              (DMA_CHANNELS * DMA_CHANNEL_STRIDE)
+// Bytes each channel may copy per RTC tick, to give transfers a duration
+#define DMA_DEFAULT_BYTES_PER_TICK (64 << 10)
+
+#define DMA_RING_BASE 0x00
+#define DMA_RING_SIZE 0x08
+#define DMA_HEAD      0x10
+#define DMA_TAIL      0x18
+#define DMA_CTRL      0x20
+#define DMA_STATUS    0x28
+
+#define DMA_CTRL_ENABLE     0x1
+#define DMA_CTRL_IRQ_ENABLE 0x2
+
+#define DMA_STATUS_DONE  0x1
+#define DMA_STATUS_ERROR 0x2
+
+#define DMA_DESC_SIZE  32
+#define DMA_DESC_IRQ   0x1
+#define DMA_DESC_ERROR (reg_t(1) << 62)
+#define DMA_DESC_DONE  (reg_t(1) << 63)
+
+class dma_t : public abstract_device_t {
+ public:
+  dma_t(const sim_t* sim, uint32_t interrupt_id, reg_t bytes_per_tick);
+  bool load(reg_t addr, size_t len, uint8_t* bytes) override;
+  bool store(reg_t addr, size_t len, const uint8_t* bytes) override;
+  void tick(reg_t rtc_ticks) override;
+  void save(std::ostream& o) override;
+  void restore(std::istream& i) override;
+
+ private:
+  struct channel_t {
+    reg_t ring_base = 0;
+    reg_t ring_size = 0;
+    reg_t head = 0;
+    reg_t tail = 0;
+    reg_t ctrl = 0;
+    reg_t status = 0;
+    reg_t progress = 0; // bytes of the descriptor at tail copied so far
+    bool faulted = false; // whether that copy has faulted
+  };
+
+  void run(channel_t& ch, reg_t budget);
+  bool copy(reg_t dst, reg_t src, reg_t len);
+  bool load_word(reg_t addr, reg_t* val);
+  bool store_word(reg_t addr, reg_t val);
+  void update_interrupt();
+
+  mmu_t* mmu;
+  abstract_interrupt_controller_t* intctrl;
+  uint32_t interrupt_id;
+  reg_t bytes_per_tick;
+  channel_t channels[DMA_CHANNELS];
+};
+
+dma_t::dma_t(const sim_t* sim, uint32_t interrupt_id, reg_t bytes_per_tick)
+  : mmu(sim->debug_mmu), intctrl(sim->get_intctrl()), interrupt_id(interrupt_id),
+    bytes_per_tick(bytes_per_tick)
+{
+}
+
+// Registers are 64 bits wide, and may be accessed 32 bits at a time
+static bool dma_access_ok(reg_t addr, size_t len)
+{
+  return (len == 4 || len == 8) && addr % len == 0 && addr < DMA_SIZE;
+}
+
+bool dma_t::load(reg_t addr, size_t len, uint8_t* bytes)
+{
+  if (!dma_access_ok(addr, len))
+    return false;
+
+  const channel_t& ch = channels[addr / DMA_CHANNEL_STRIDE];
+  reg_t val;
+  switch (addr % DMA_CHANNEL_STRIDE & ~reg_t(7)) {
+    case DMA_RING_BASE: val = ch.ring_base; break;
+    case DMA_RING_SIZE: val = ch.ring_size; break;
+    case DMA_HEAD: val = ch.head; break;
+    case DMA_TAIL: val = ch.tail; break;
+    case DMA_CTRL: val = ch.ctrl; break;
+    case DMA_STATUS: val = ch.status; break;
+    default: return false;
+  }
+  read_little_endian_reg(val, addr, len, bytes);
+  return true;
+}
+
+bool dma_t::store(reg_t addr, size_t len, const uint8_t* bytes)
+{
+  if (!dma_access_ok(addr, len))
+    return false;
+
+  channel_t& ch = channels[addr / DMA_CHANNEL_STRIDE];
+  reg_t val = 0;
+  switch (addr % DMA_CHANNEL_STRIDE & ~reg_t(7)) {
+    // Moving the ring abandons the descriptor in progress
+    case DMA_RING_BASE:
+      write_little_endian_reg(&ch.ring_base, addr, len, bytes);
+      ch.head = ch.tail = ch.progress = 0;
+      ch.faulted = false;
+      break;
+    case DMA_RING_SIZE:
+      write_little_endian_reg(&ch.ring_size, addr, len, bytes);
+      ch.head = ch.tail = ch.progress = 0;
+      ch.faulted = false;
+      break;
+    case DMA_HEAD:
+      write_little_endian_reg(&val, addr, len, bytes);
+      ch.head = ch.ring_size ? val % ch.ring_size : 0;
+      break;
+    case DMA_TAIL:
+      break;
+    case DMA_CTRL:
+      write_little_endian_reg(&val, addr, len, bytes);
+      ch.ctrl = val & (DMA_CTRL_ENABLE | DMA_CTRL_IRQ_ENABLE);
+      break;
+    case DMA_STATUS:
+      write_little_endian_reg(&val, addr, len, bytes);
+      ch.status &= ~val;
+      break;
+    default:
+      return false;
+  }
+  update_interrupt();
+  return true;
+}
+
+void dma_t::tick(reg_t rtc_ticks)
+{
+  for (auto& ch : channels)
+    if ((ch.ctrl & DMA_CTRL_ENABLE) && ch.tail != ch.head)
+      run(ch, rtc_ticks * bytes_per_tick);
+  update_interrupt();
+}
+
+// Works through the ring of ch until it is empty or budget bytes are copied
+void dma_t::run(channel_t& ch, reg_t budget)
+{
+  while (ch.tail != ch.head && budget > 0) {
+    const reg_t desc = ch.ring_base + ch.tail * DMA_DESC_SIZE;
+    reg_t src, dst, len, flags;
+    if (!load_word(desc, &src) || !load_word(desc + 8, &dst) ||
+        !load_word(desc + 16, &len) || !load_word(desc + 24, &flags)) {
+      // Without its descriptors the channel cannot go on
+      ch.status |= DMA_STATUS_ERROR;
+      ch.ctrl &= ~DMA_CTRL_ENABLE;
+      return;
+    }
+
+    if (!ch.faulted) {
+      const reg_t n = std::min(len - std::min(len, ch.progress), budget);
+      ch.faulted = !copy(dst + ch.progress, src + ch.progress, n);
+      ch.progress += n;
+      budget -= n;
+      if (ch.progress < len && !ch.faulted)
+        return;
+    }
+
+    flags |= DMA_DESC_DONE | (ch.faulted ? DMA_DESC_ERROR : 0);
+    if (!store_word(desc + 24, flags))
+      ch.faulted = true;
+    if (ch.faulted)
+      ch.status |= DMA_STATUS_ERROR;
+    if (flags & DMA_DESC_IRQ)
+      ch.status |= DMA_STATUS_DONE;
+    ch.tail = (ch.tail + 1) % ch.ring_size;
+    ch.progress = 0;
+    ch.faulted = false;
+  }
+}
+
+// Copies len bytes a page at a time, stopping at the first refused access
+bool dma_t::copy(reg_t dst, reg_t src, reg_t len)
+{
+  uint8_t buf[PGSIZE];
+  while (len > 0) {
+    const reg_t n = std::min({len, PGSIZE - src % PGSIZE, PGSIZE - dst % PGSIZE});
+    if (!mmu->dma_load(src, n, buf, sid) || !mmu->dma_store(dst, n, buf, sid))
+      return false;
+    src += n;
+    dst += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool dma_t::load_word(reg_t addr, reg_t* val)
+{
+  uint8_t bytes[8];
+  if (addr % 8 != 0 || !mmu->dma_load(addr, sizeof(bytes), bytes, sid))
+    return false;
+  *val = 0;
+  write_little_endian_reg(val, 0, sizeof(bytes), bytes);
+  return true;
+}
+
+bool dma_t::store_word(reg_t addr, reg_t val)
+{
+  uint8_t bytes[8];
+  read_little_endian_reg(val, 0, sizeof(bytes), bytes);
+  return addr % 8 == 0 && mmu->dma_store(addr, sizeof(bytes), bytes, sid);
+}
+
+void dma_t::update_interrupt()
+{
+  bool level = false;
+  for (auto& ch : channels)
+    level |= (ch.ctrl & DMA_CTRL_IRQ_ENABLE) && ch.status;
+  intctrl->set_interrupt_level(interrupt_id, level);
+}
+
+void dma_t::save(std::ostream& o)
+{
+  for (auto& ch : channels)
+    checkpoint_write(o, ch);
+}
+
+void dma_t::restore(std::istream& i)
+{
+  for (auto& ch : channels)
+    checkpoint_read(i, ch);
+  update_interrupt();
+}
+
+static std::string dma_generate_dts(const sim_t* UNUSED sim)
+{
+  std::stringstream s;
+  s << std::hex
+    << "    DMA: dma@" << DMA_BASE << " {\n"
+       "      compatible = \"spike,dma\";\n"
+       "      interrupt-parent = <&PLIC>;\n"
+       "      interrupts = <" << std::dec << DMA_INTERRUPT_ID << ">;\n"
+       "      dma-channels = <" << DMA_CHANNELS << ">;\n" << std::hex <<
+       "      reg = <0x0 0x" << DMA_BASE << " 0x0 0x" << DMA_SIZE << ">;\n"
+       "    };\n";
+  return s.str();
+}
+
+static dma_t* dma_parse_from_fdt(const void* fdt, const sim_t* sim, reg_t* base, const std::vector<std::string>& sargs)
+{
+  int node = fdt_node_offset_by_compatible(fdt, -1, "spike,dma");
+  if (node < 0 || fdt_get_node_addr_size(fdt, node, base, NULL, "reg") < 0)
+    return nullptr;
+
+  int len;
+  const fdt32_t* p = (const fdt32_t*)fdt_getprop(fdt, node, "interrupts", &len);
+  const uint32_t interrupt_id = p ? fdt32_to_cpu(*p) : DMA_INTERRUPT_ID;
+  const reg_t bytes_per_tick = sargs.empty() ? DMA_DEFAULT_BYTES_PER_TICK : strtoull(sargs[0].c_str(), NULL, 0);
+  if (bytes_per_tick == 0)
+    throw std::runtime_error("dma: the number of bytes per tick must be nonzero");
+
+  return new dma_t(sim, interrupt_id, bytes_per_tick);
+}
+
+REGISTER_DEVICE(dma, dma_parse_from_fdt, dma_generate_dts)
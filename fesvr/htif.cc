@@ -207,6 +207,18 @@ const char* htif_t::get_symbol(uint64_t addr)
   return it->second.c_str();
 }
 
+const char* htif_t::get_symbol_containing(uint64_t addr, uint64_t* base)
+{
+  auto it = addr2symbol.upper_bound(addr);
+
+  if(it == addr2symbol.begin())
+      return nullptr;
+
+  --it;
+  *base = it->first;
+  return it->second.c_str();
+}
+
 void htif_t::stop()
 {
   if (!sig_file.empty() && sig_len) // print final torture test signature
@@ -73,6 +73,9 @@ class htif_t : public chunked_memif_t
 
   // Given an address, return symbol from addr2symbol map
   const char* get_symbol(uint64_t addr);
+  // Given an address, return the nearest symbol at or below it, and the
+  // address of that symbol in *base
+  const char* get_symbol_containing(uint64_t addr, uint64_t* base);
 
  private:
   void parse_arguments(int argc, char ** argv);
@@ -0,0 +1,187 @@
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <vector>
+#include "iopmp-bench.h"
+#include "util.h"
+
+// run_iopmp_bench measures the throughput of the path that bus-mastering
+// devices take to memory, mmu_t::dma_load and mmu_t::dma_store, for a range
+// of transfer sizes.  Each transfer is copied a page at a time, like the DMA
+// controller in customext does, once with the IOPMP bypassed and once with
+// every page checked against a memory domain that owns all entries.
+//
+// run_iopmp_scaling_bench measures the latency of mmu_t::iopmp_ok as the
+// number of sources, memory domains and entries grows to the maximum, over
+// random TOR, NA4 and NAPOT configurations, next to an in-order scan of the
+// entries.  It fails when the largest configuration is much slower than the
+// smallest, as the cost of a check should barely depend on the table sizes.
+
+#define BENCH_MEM_SIZE    (8 << 20)
+#define BENCH_BYTES       (256 << 20)
+
+#define SCALING_SPAN         (1 << 20)
+#define SCALING_CONFIGS      8
+#define SCALING_TRANSACTIONS 4096
+#define SCALING_CHECKS       (4 << 20)
+//How much slower than the smallest configuration the largest may be
+#define SCALING_MAX_RATIO    8
+
+// A system of nothing but memory at address 0
+class bench_sim_t : public simif_t {
+  public:
+    bench_sim_t() : mem(BENCH_MEM_SIZE) {}
+    char* addr_to_mem(reg_t paddr) override { return paddr < mem.size() ? &mem[paddr] : NULL; }
+    bool mmio_load(reg_t UNUSED paddr, size_t UNUSED len, uint8_t UNUSED *bytes) override { return false; }
+    bool mmio_store(reg_t UNUSED paddr, size_t UNUSED len, const uint8_t UNUSED *bytes) override { return false; }
+    void proc_reset(unsigned UNUSED id) override {}
+    const cfg_t &get_cfg() const override { return cfg; }
+    const std::map<size_t, processor_t*>& get_harts() const override { return harts; }
+    const char* get_symbol(uint64_t UNUSED paddr) override { return NULL; }
+  private:
+    std::vector<char> mem;
+    cfg_t cfg;
+    std::map<size_t, processor_t*> harts;
+};
+
+// Copies len bytes from src to dst a page at a time, as source sid
+static bool dma_copy(mmu_t* mmu, reg_t dst, reg_t src, reg_t len, reg_t sid) {
+    uint8_t buf[PGSIZE];
+    while (len > 0) {
+        reg_t n = std::min({len, PGSIZE - src % PGSIZE, PGSIZE - dst % PGSIZE});
+        if (!mmu->dma_load(src, n, buf, sid) || !mmu->dma_store(dst, n, buf, sid))
+            return false;
+        src += n;
+        dst += n;
+        len -= n;
+    }
+    return true;
+}
+
+// Returns the bytes per second copied in transfers of the given size
+static double measure(mmu_t* mmu, reg_t size, reg_t sid) {
+    const reg_t half = BENCH_MEM_SIZE / 2;
+    const reg_t transfers = std::max<reg_t>(BENCH_BYTES / size, 16);
+    auto start = std::chrono::steady_clock::now();
+    for (reg_t i = 0; i < transfers; i++) {
+        reg_t offset = (i * size) % (half - size + 1);
+        if (!dma_copy(mmu, half + offset, offset, size, sid)) {
+            std::cerr << "spike: DMA transfer refused by the IOPMP" << std::endl;
+            exit(1);
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return transfers * size / elapsed.count();
+}
+
+void run_iopmp_bench() {
+    std::cout << "IOPMP DMA benchmark" << std::endl;
+
+    processor_t* proc = create_processor();
+    bench_sim_t sim;
+    mmu_t* mmu = new mmu_t(&sim, endianness_little, NULL, proc);
+
+    //Source id 0 is associated with memory domain 0, which owns all entries
+    get_srcmd(proc, 0)->write(1 << SRCMD_BITMAP_BASE);
+    get_mdcfg(proc, 0)->write(ENTRY);
+    //Entries 1 to ENTRY-3 match pages above memory, and entries 0 and ENTRY-2
+    //are off, only serving as the bottom of the range of the entry after them
+    store_paddr(get_entry_addr(proc, 0), BENCH_MEM_SIZE);
+    for (int i = 1; i < ENTRY - 2; i++) {
+        write_entry_cfg(proc, i, ENTRY_CFG_TOR | ENTRY_CFG_R);
+        store_paddr(get_entry_addr(proc, i), BENCH_MEM_SIZE + i * PGSIZE);
+    }
+    store_paddr(get_entry_addr(proc, ENTRY - 2), 0);
+    //The last entry grants reads and writes to all of memory, [0, BENCH_MEM_SIZE)
+    write_entry_cfg(proc, ENTRY - 1, ENTRY_CFG_TOR | ENTRY_CFG_R | ENTRY_CFG_W);
+    store_paddr(get_entry_addr(proc, ENTRY - 1), BENCH_MEM_SIZE);
+
+    printf("%10s %14s %14s %14s\n", "size", "no IOPMP MB/s", "IOPMP MB/s", "ns/transfer");
+    for (reg_t size = 8; size <= (1 << 20); size *= 8) {
+        double off = measure(mmu, size, UINT64_MAX);
+        double on  = measure(mmu, size, 0);
+        double cost = (size / on - size / off) * 1e9;
+        printf("%10" PRIu64 " %14.1f %14.1f %14.1f\n", size, off / 1e6, on / 1e6, cost);
+    }
+    std::cout << std::endl;
+
+    delete mmu;
+}
+
+struct transaction_t {
+    reg_t sid;
+    reg_t addr;
+    reg_t len;
+    access_type type;
+};
+
+//Returns the nanoseconds per check of SCALING_CHECKS transactions, taken in turn from the given ones
+template<typename F>
+static double time_checks(const std::vector<transaction_t>& transactions, F check) {
+    reg_t allowed = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (reg_t i = 0; i < SCALING_CHECKS; i++) {
+        const transaction_t& t = transactions[i % transactions.size()];
+        allowed += check(t);
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    //Keep the checks from being optimized away
+    volatile reg_t sink = allowed;
+    (void)sink;
+    return elapsed.count() / SCALING_CHECKS;
+}
+
+bool run_iopmp_scaling_bench() {
+    std::cout << "IOPMP scaling benchmark" << std::endl;
+
+    struct dimensions_t { reg_t mds, sids, entries; };
+    const dimensions_t dimensions[] = {{1, 1, 1}, {4, 4, 4}, {16, SID, ENTRY}, {MD, SID, ENTRY}};
+    const reg_t lens[] = {1, 2, 4, 8, 64, 4096};
+    const access_type types[] = {LOAD, STORE, FETCH};
+
+    printf("%5s %5s %8s %12s %12s %14s %14s\n", "mds", "sids", "entries", "ns/check", "Mchecks/s", "scan ns/check", "scan Mchecks/s");
+    double first = 0, last = 0;
+    for (const dimensions_t& d : dimensions) {
+        std::mt19937_64 rng(1);
+        double index_ns = 0, scan_ns = 0;
+        for (int config = 0; config < SCALING_CONFIGS; config++) {
+            processor_t* proc = create_processor(d.mds, d.sids, d.entries);
+            mmu_t* mmu        = create_mmu(proc);
+            randomize_iopmp(proc, rng, SCALING_SPAN);
+
+            std::vector<transaction_t> transactions(SCALING_TRANSACTIONS);
+            for (transaction_t& t : transactions) {
+                t.sid  = rng() % d.sids;
+                t.len  = lens[rng() % 6];
+                t.addr = (rng() % SCALING_SPAN) & ~(t.len - 1);
+                t.type = types[rng() % 3];
+            }
+
+            index_ns += time_checks(transactions, [&](const transaction_t& t) {
+                return mmu->iopmp_ok(t.sid, t.addr, t.len, t.type);
+            });
+            scan_ns += time_checks(transactions, [&](const transaction_t& t) {
+                return reference_iopmp_ok(proc, t.sid, t.addr, t.len, t.type);
+            });
+
+            delete mmu;
+            delete proc;
+        }
+        index_ns /= SCALING_CONFIGS;
+        scan_ns  /= SCALING_CONFIGS;
+        printf("%5" PRIu64 " %5" PRIu64 " %8" PRIu64 " %12.1f %12.1f %14.1f %14.1f\n",
+               d.mds, d.sids, d.entries, index_ns, 1e3 / index_ns, scan_ns, 1e3 / scan_ns);
+        if (first == 0)
+            first = index_ns;
+        last = index_ns;
+    }
+    std::cout << std::endl;
+
+    if (last > SCALING_MAX_RATIO * first) {
+        std::cerr << "spike: iopmp_ok with the largest configuration is more than " << SCALING_MAX_RATIO
+                  << " times slower than with the smallest" << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,2 @@
+void run_iopmp_bench();
+bool run_iopmp_scaling_bench();
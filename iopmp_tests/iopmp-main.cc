@@ -1,6 +1,7 @@
 #include <iostream>
 #include "csr-tests.h"
 #include "mmu-tests.h"
+#include "iopmp-bench.h"
 #include "iopmp-main.h"
 
 void iopmp_tests_main() {
@@ -8,4 +9,10 @@ void iopmp_tests_main() {
     run_csr_tests();
     run_mmu_tests();
     exit(0);
+}
+
+void iopmp_bench_main() {
+    std::cout << "Running IOPMP benchmarks ..." << std::endl << std::endl;
+    run_iopmp_bench();
+    exit(run_iopmp_scaling_bench() ? 0 : 1);
 }
\ No newline at end of file
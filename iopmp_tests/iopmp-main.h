@@ -1 +1,2 @@
-void iopmp_tests_main();
\ No newline at end of file
+void iopmp_tests_main();
+void iopmp_bench_main();
\ No newline at end of file
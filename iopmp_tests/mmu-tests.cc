@@ -102,6 +102,238 @@ void test_iopmp_ok_two_entries_match() {
     ASSERT("When the two entries match the same address range and the transaction is legal according to the second entry, the transaction is legal", mmu->iopmp_ok(sid, 0, 12, STORE));
 }
 
+void test_iopmp_ok_transaction_spans_two_entries() {
+    processor_t* proc              = create_processor();
+    srcmd_csr_t_p srcmd0           = get_srcmd(proc, 0);
+    mdcfg_csr_t_p mdcfg0           = get_mdcfg(proc, 0);
+    entry_addr_csr_t_p entry_addr0 = get_entry_addr(proc, 0);
+    entry_addr_csr_t_p entry_addr1 = get_entry_addr(proc, 1);
+    mmu_t* mmu                     = create_mmu(proc);
+
+    //Source id 0
+    reg_t sid = 0;
+    //Associate source id 0 with memory domain 0
+    srcmd0->write(1 << SRCMD_BITMAP_BASE);
+    //Memory domain 0 owns entry 0,1
+    mdcfg0->write(2);
+    //Entry 0 configured as TOR and read only
+    write_entry_cfg(proc, 0, ENTRY_CFG_TOR | ENTRY_CFG_R);
+    //Entry 0 has a physical top address of 0x8 (matching [0, 8))
+    store_paddr(entry_addr0, 0x8);
+    //Entry 1 configured as TOR and read only
+    write_entry_cfg(proc, 1, ENTRY_CFG_TOR | ENTRY_CFG_R);
+    //Entry 1 has a physical top address of 0x10 (matching [8, 16))
+    store_paddr(entry_addr1, 0x10);
+
+    ASSERT("When the transaction lies within the second entry, the transaction is legal",                         mmu->iopmp_ok(sid, 8, 8, LOAD));
+    ASSERT("When the transaction spans two adjacent entries that both grant it, the transaction is illegal",     !mmu->iopmp_ok(sid, 4, 8, LOAD));
+}
+
+void test_iopmp_ok_entries_out_of_address_order() {
+    processor_t* proc              = create_processor();
+    srcmd_csr_t_p srcmd0           = get_srcmd(proc, 0);
+    mdcfg_csr_t_p mdcfg0           = get_mdcfg(proc, 0);
+    entry_addr_csr_t_p entry_addr0 = get_entry_addr(proc, 0);
+    entry_addr_csr_t_p entry_addr1 = get_entry_addr(proc, 1);
+    entry_addr_csr_t_p entry_addr2 = get_entry_addr(proc, 2);
+    mmu_t* mmu                     = create_mmu(proc);
+
+    //Source id 0
+    reg_t sid = 0;
+    //Associate source id 0 with memory domain 0
+    srcmd0->write(1 << SRCMD_BITMAP_BASE);
+    //Memory domain 0 owns entry 0,1,2
+    mdcfg0->write(3);
+    //Entry 0 configured as TOR and read only, matching [0, 0x100)
+    write_entry_cfg(proc, 0, ENTRY_CFG_TOR | ENTRY_CFG_R);
+    store_paddr(entry_addr0, 0x100);
+    //Entry 1 configured as TOR and read only, with a top below its base so it matches nothing
+    write_entry_cfg(proc, 1, ENTRY_CFG_TOR | ENTRY_CFG_R);
+    store_paddr(entry_addr1, 0x10);
+    //Entry 2 configured as TOR and write only, matching [0x10, 0x40)
+    write_entry_cfg(proc, 2, ENTRY_CFG_TOR | ENTRY_CFG_W);
+    store_paddr(entry_addr2, 0x40);
+
+    ASSERT("When an entry with a lower address range follows a wider one, the wider one still grants the transaction", mmu->iopmp_ok(sid, 0x20, 8, LOAD));
+    ASSERT("When an entry with a lower address range follows a wider one, its own permissions apply",                   mmu->iopmp_ok(sid, 0x20, 8, STORE));
+    ASSERT("When the transaction lies only within the wider entry, its permissions apply",                              !mmu->iopmp_ok(sid, 0x80, 8, STORE));
+    ASSERT("When an entry has a top below its base, it matches no transaction",                                          !mmu->iopmp_ok(sid, 0x100, 8, LOAD));
+}
+
+void test_iopmp_ok_after_reconfiguration() {
+    processor_t* proc              = create_processor();
+    srcmd_csr_t_p srcmd0           = get_srcmd(proc, 0);
+    mdcfg_csr_t_p mdcfg0           = get_mdcfg(proc, 0);
+    entry_addr_csr_t_p entry_addr0 = get_entry_addr(proc, 0);
+    mmu_t* mmu                     = create_mmu(proc);
+
+    //Source id 0
+    reg_t sid = 0;
+    //Associate source id 0 with memory domain 0
+    srcmd0->write(1 << SRCMD_BITMAP_BASE);
+    //Memory domain 0 owns entry 0
+    mdcfg0->write(1);
+    //Entry 0 configured as TOR and read only
+    write_entry_cfg(proc, 0, ENTRY_CFG_TOR | ENTRY_CFG_R);
+    //Entry 0 has a physical top address of 0xC (matching [0, 12))
+    store_paddr(entry_addr0, 0xC);
+
+    ASSERT("When the entry grants the transaction, the transaction is legal", mmu->iopmp_ok(sid, 0, 12, LOAD));
+
+    //Entry 0 reconfigured as write only
+    write_entry_cfg(proc, 0, ENTRY_CFG_TOR | ENTRY_CFG_W);
+    ASSERT("When the entry configuration is written after a transaction, the new configuration applies",   !mmu->iopmp_ok(sid, 0, 12, LOAD));
+
+    //Entry 0 has a physical top address of 0x10 (matching [0, 16))
+    store_paddr(entry_addr0, 0x10);
+    ASSERT("When the entry address is written after a transaction, the new address applies",               mmu->iopmp_ok(sid, 0, 16, STORE));
+
+    //Memory domain 0 owns no entry
+    mdcfg0->write(0);
+    ASSERT("When the mdcfg is written after a transaction, the new memory domain applies",                  !mmu->iopmp_ok(sid, 0, 16, STORE));
+
+    //Memory domain 0 owns entry 0 again, but source id 0 is not associated with it
+    mdcfg0->write(1);
+    srcmd0->write(0);
+    ASSERT("When the srcmd is written after a transaction, the new association applies",                    !mmu->iopmp_ok(sid, 0, 16, STORE));
+}
+
+void test_iopmp_ok_page_split_between_entries() {
+    processor_t* proc              = create_processor();
+    srcmd_csr_t_p srcmd0           = get_srcmd(proc, 0);
+    mdcfg_csr_t_p mdcfg0           = get_mdcfg(proc, 0);
+    entry_addr_csr_t_p entry_addr0 = get_entry_addr(proc, 0);
+    entry_addr_csr_t_p entry_addr1 = get_entry_addr(proc, 1);
+    mmu_t* mmu                     = create_mmu(proc);
+
+    //Source id 0
+    reg_t sid = 0;
+    //Associate source id 0 with memory domain 0
+    srcmd0->write(1 << SRCMD_BITMAP_BASE);
+    //Memory domain 0 owns entry 0,1
+    mdcfg0->write(2);
+    //Entry 0 configured as TOR and read only, matching [0, 0x800)
+    write_entry_cfg(proc, 0, ENTRY_CFG_TOR | ENTRY_CFG_R);
+    store_paddr(entry_addr0, 0x800);
+    //Entry 1 configured as TOR and read only, matching [0x800, 0x1000)
+    write_entry_cfg(proc, 1, ENTRY_CFG_TOR | ENTRY_CFG_R);
+    store_paddr(entry_addr1, 0x1000);
+
+    ASSERT("When a page is split between two entries, a transaction within the first entry is legal",      mmu->iopmp_ok(sid, 0x0, 8, LOAD));
+    ASSERT("When a page is split between two entries, a transaction within the second entry is legal",     mmu->iopmp_ok(sid, 0x800, 8, LOAD));
+    ASSERT("When a page is split between two entries, a transaction spanning both entries is illegal",     !mmu->iopmp_ok(sid, 0x7FC, 8, LOAD));
+}
+
+void test_iopmp_ok_repeated_within_page() {
+    processor_t* proc              = create_processor();
+    srcmd_csr_t_p srcmd0           = get_srcmd(proc, 0);
+    mdcfg_csr_t_p mdcfg0           = get_mdcfg(proc, 0);
+    entry_addr_csr_t_p entry_addr0 = get_entry_addr(proc, 0);
+    mmu_t* mmu                     = create_mmu(proc);
+
+    //Source id 0
+    reg_t sid = 0;
+    //Associate source id 0 with memory domain 0
+    srcmd0->write(1 << SRCMD_BITMAP_BASE);
+    //Memory domain 0 owns entry 0
+    mdcfg0->write(1);
+    //Entry 0 configured as TOR and read only, matching [0, 0x2000)
+    write_entry_cfg(proc, 0, ENTRY_CFG_TOR | ENTRY_CFG_R);
+    store_paddr(entry_addr0, 0x2000);
+
+    ASSERT("When a page lies within an entry, a transaction within the page is legal",                       mmu->iopmp_ok(sid, 0x10, 8, LOAD));
+    ASSERT("When a page lies within an entry, another transaction within the page is legal",                 mmu->iopmp_ok(sid, 0x20, 4, LOAD));
+    ASSERT("When a page lies within an entry, a transaction of another type is checked on its own",          !mmu->iopmp_ok(sid, 0x10, 8, STORE));
+    ASSERT("When a page lies within an entry, a transaction of another source is checked on its own",        !mmu->iopmp_ok(1, 0x10, 8, LOAD));
+    ASSERT("When a transaction spans two pages that lie within an entry, the transaction is legal",          mmu->iopmp_ok(sid, 0xFFC, 8, LOAD));
+    ASSERT("When a page lies outside all entries, a transaction within the page is illegal",                 !mmu->iopmp_ok(sid, 0x2010, 8, LOAD));
+
+    //Entry 0 reconfigured to match [0, 0x3000)
+    store_paddr(entry_addr0, 0x3000);
+    ASSERT("When the entry address is written after a transaction within a page, the new address applies",   mmu->iopmp_ok(sid, 0x2010, 8, LOAD));
+}
+
+void test_iopmp_ok_na4() {
+    processor_t* proc              = create_processor();
+    srcmd_csr_t_p srcmd0           = get_srcmd(proc, 0);
+    mdcfg_csr_t_p mdcfg0           = get_mdcfg(proc, 0);
+    entry_addr_csr_t_p entry_addr0 = get_entry_addr(proc, 0);
+    mmu_t* mmu                     = create_mmu(proc);
+
+    //Source id 0
+    reg_t sid = 0;
+    //Associate source id 0 with memory domain 0
+    srcmd0->write(1 << SRCMD_BITMAP_BASE);
+    //Memory domain 0 owns entry 0
+    mdcfg0->write(1);
+    //Entry 0 configured as NA4 and read only, matching [0x100, 0x104)
+    write_entry_cfg(proc, 0, ENTRY_CFG_NA4 | ENTRY_CFG_R);
+    store_paddr(entry_addr0, 0x100);
+
+    ASSERT("When the entry is NA4 and the transaction covers its four bytes, the transaction is legal",  mmu->iopmp_ok(sid, 0x100, 4, LOAD));
+    ASSERT("When the entry is NA4 and the transaction covers one of its bytes, the transaction is legal", mmu->iopmp_ok(sid, 0x103, 1, LOAD));
+    ASSERT("When the entry is NA4 and the transaction extends past it, the transaction is illegal",      !mmu->iopmp_ok(sid, 0x100, 8, LOAD));
+    ASSERT("When the entry is NA4 and the transaction lies below it, the transaction is illegal",        !mmu->iopmp_ok(sid, 0xFC, 4, LOAD));
+}
+
+void test_iopmp_ok_napot() {
+    processor_t* proc              = create_processor();
+    srcmd_csr_t_p srcmd0           = get_srcmd(proc, 0);
+    mdcfg_csr_t_p mdcfg0           = get_mdcfg(proc, 0);
+    entry_addr_csr_t_p entry_addr0 = get_entry_addr(proc, 0);
+    mmu_t* mmu                     = create_mmu(proc);
+
+    //Source id 0
+    reg_t sid = 0;
+    //Associate source id 0 with memory domain 0
+    srcmd0->write(1 << SRCMD_BITMAP_BASE);
+    //Memory domain 0 owns entry 0
+    mdcfg0->write(1);
+    //Entry 0 configured as NAPOT and write only, matching the 8 KiB at [0x4000, 0x6000)
+    write_entry_cfg(proc, 0, ENTRY_CFG_NAPOT | ENTRY_CFG_W);
+    entry_addr0->write((0x4000 >> ENTRY_ADDR_SHIFT) | ((0x2000 >> 3) - 1));
+
+    ASSERT("When the entry is NAPOT and the transaction lies at its start, the transaction is legal",    mmu->iopmp_ok(sid, 0x4000, 8, STORE));
+    ASSERT("When the entry is NAPOT and the transaction lies at its end, the transaction is legal",      mmu->iopmp_ok(sid, 0x5FF8, 8, STORE));
+    ASSERT("When the entry is NAPOT and the transaction extends past it, the transaction is illegal",    !mmu->iopmp_ok(sid, 0x5FFC, 8, STORE));
+    ASSERT("When the entry is NAPOT and the configuration does not match, the transaction is illegal",   !mmu->iopmp_ok(sid, 0x4000, 8, LOAD));
+
+    //Entry 0 matching the 8 bytes at [0x4000, 0x4008)
+    entry_addr0->write(0x4000 >> ENTRY_ADDR_SHIFT);
+    ASSERT("When the entry is the smallest NAPOT region, a transaction of its eight bytes is legal",     mmu->iopmp_ok(sid, 0x4000, 8, STORE));
+    ASSERT("When the entry is the smallest NAPOT region, a transaction past it is illegal",              !mmu->iopmp_ok(sid, 0x4008, 4, STORE));
+}
+
+void test_iopmp_ok_randomized() {
+    std::mt19937_64 rng(1);
+    const reg_t span = 0x10000;
+    const reg_t lens[] = {1, 2, 4, 8, 64, 4096};
+    const access_type types[] = {LOAD, STORE, FETCH};
+
+    for (int config = 0; config < 50; config++) {
+        processor_t* proc = create_processor(1 + rng() % MD, 1 + rng() % SID, 1 + rng() % ENTRY);
+        mmu_t* mmu        = create_mmu(proc);
+        randomize_iopmp(proc, rng, span);
+
+        int mismatches = 0;
+        for (int i = 0; i < 2000; i++) {
+            //Now and then the configuration changes between transactions
+            if (i % 500 == 499)
+                randomize_iopmp(proc, rng, span);
+            reg_t sid         = rng() % proc->sid_num;
+            reg_t len         = lens[rng() % 6];
+            reg_t addr        = rng() % span;
+            access_type type  = types[rng() % 3];
+            //Transactions are naturally aligned half of the time
+            if (rng() % 2)
+                addr &= ~(len - 1);
+            if (mmu->iopmp_ok(sid, addr, len, type) != reference_iopmp_ok(proc, sid, addr, len, type))
+                mismatches++;
+        }
+        ASSERT("For a random IOPMP configuration, every transaction gets the verdict of an in-order scan of the entries", mismatches == 0);
+    }
+}
+
 
 void run_mmu_tests() {
     std::cout << "IOPMP MMU tests" << std::endl;
@@ -111,6 +343,14 @@ void run_mmu_tests() {
     test_iopmp_ok_source_linked_with_no_md();
     test_iopmp_ok_md_linked_with_no_entry();
     test_iopmp_ok_two_entries_match();
+    test_iopmp_ok_transaction_spans_two_entries();
+    test_iopmp_ok_entries_out_of_address_order();
+    test_iopmp_ok_after_reconfiguration();
+    test_iopmp_ok_page_split_between_entries();
+    test_iopmp_ok_repeated_within_page();
+    test_iopmp_ok_na4();
+    test_iopmp_ok_napot();
+    test_iopmp_ok_randomized();
 
     end_test();
 }
\ No newline at end of file
@@ -11,10 +11,15 @@ cfg_t* create_cfg() {
 
 //Creates a processor object with dummy values
 processor_t* create_processor() {
+    return create_processor(MD, SID, ENTRY);
+}
+
+//Creates a processor object with the given IOPMP dimensions and dummy values otherwise
+processor_t* create_processor(reg_t mds, reg_t sids, reg_t entries) {
     cfg_t* cfg = create_cfg();
-    cfg->memorydomains = MD;
-    cfg->sourceids     = SID;
-    cfg->entrynum      = ENTRY;
+    cfg->memorydomains = mds;
+    cfg->sourceids     = sids;
+    cfg->entrynum      = entries;
     //Create dummy values for the other parameters
     isa_parser_t isa = isa_parser_t(DEFAULT_ISA, DEFAULT_PRIV);
     simif_t* sim = nullptr;
@@ -66,6 +71,78 @@ entrylck_csr_t_p get_entrylck(processor_t* proc) {
     return proc->get_state()->entrylck;
 }
 
+//Fills the IOPMP CSRs of proc with a random configuration whose entries lie in [0, span)
+//Entries are TOR, NA4 or NAPOT with random permissions, or off
+void randomize_iopmp(processor_t* proc, std::mt19937_64& rng, reg_t span) {
+    //Each source is associated with a random set of memory domains
+    for (reg_t i = 0; i < proc->sid_num; i++)
+        get_srcmd(proc, i)->write(rng() << SRCMD_BITMAP_BASE);
+
+    //Each memory domain owns a random, possibly empty, run of entries.  The tops must stay
+    //monotonic, so they are first all raised to the end of the entry array
+    for (reg_t i = proc->md_num; i-- > 0;)
+        get_mdcfg(proc, i)->write(proc->entry_num);
+    reg_t top = 0;
+    for (reg_t i = 0; i < proc->md_num; i++) {
+        top += rng() % 3 == 0 ? rng() % 3 : 0;
+        top = std::min(top, proc->entry_num);
+        get_mdcfg(proc, i)->write(i == proc->md_num - 1 ? proc->entry_num : top);
+    }
+
+    const reg_t modes[] = {ENTRY_CFG_OFF, ENTRY_CFG_TOR, ENTRY_CFG_NA4, ENTRY_CFG_NAPOT};
+    for (reg_t i = 0; i < proc->entry_num; i++) {
+        reg_t mode = modes[rng() % 4];
+        write_entry_cfg(proc, i, mode | (rng() & (ENTRY_CFG_R | ENTRY_CFG_W | ENTRY_CFG_X)));
+        reg_t addr = (rng() % span) >> ENTRY_ADDR_SHIFT;
+        if (mode == ENTRY_CFG_NAPOT) {
+            //A region of 2^(k+3) bytes, naturally aligned
+            reg_t k = rng() % 12;
+            addr = (addr & ~((reg_t(2) << k) - 1)) | ((reg_t(1) << k) - 1);
+        }
+        get_entry_addr(proc, i)->write(addr);
+    }
+}
+
+//Checks a transaction against the IOPMP CSRs by scanning the entries in order, computing the range
+//of each from the raw CSR values, as specified in section 2.6: Priority and Matching Logic, of the
+//RISC-V IOPMP specification (Version 1.0.0-draft5), independently of mmu_t::iopmp_ok
+bool reference_iopmp_ok(processor_t* proc, reg_t sid, reg_t addr, reg_t len, access_type type) {
+    std::vector<reg_t> entry_idxs;
+    for (reg_t md : get_srcmd(proc, sid)->associated_mds())
+        get_mdcfg(proc, md)->entries_belonging_to_md(&entry_idxs);
+
+    const reg_t perm = type == LOAD ? ENTRY_CFG_R : type == STORE ? ENTRY_CFG_W : ENTRY_CFG_X;
+    for (reg_t i : entry_idxs) {
+        reg_t cfg = read_entry_cfg(proc, i);
+        reg_t val = get_entry_addr(proc, i)->read();
+        unsigned __int128 base, top;
+        switch (cfg & ENTRY_CFG_A) {
+            case ENTRY_CFG_TOR:
+                base = i == 0 ? 0 : (unsigned __int128)get_entry_addr(proc, i - 1)->read() << ENTRY_ADDR_SHIFT;
+                top  = (unsigned __int128)val << ENTRY_ADDR_SHIFT;
+                break;
+            case ENTRY_CFG_NA4:
+                base = (unsigned __int128)val << ENTRY_ADDR_SHIFT;
+                top  = base + 4;
+                break;
+            case ENTRY_CFG_NAPOT: {
+                int k = 0;
+                while (k < 64 && ((val >> k) & 1))
+                    k++;
+                unsigned __int128 size = (unsigned __int128)8 << k;
+                base = ((unsigned __int128)val << ENTRY_ADDR_SHIFT) & ~(size - 1);
+                top  = base + size;
+                break;
+            }
+            default:
+                continue;
+        }
+        if (base <= addr && addr + (unsigned __int128)len <= top && (cfg & perm))
+            return true;
+    }
+    return false;
+}
+
 void end_test() {
     std::cout << "Tests passed: " << passed_tests << std::endl;
     std::cout << "Tests failed: " << failed_tests << std::endl;
@@ -3,6 +3,7 @@
 #include "processor.h"
 #include "encoding.h"
 #include "mmu.h"
+#include <random>
 
 #define MD    63
 #define SID   16
@@ -35,6 +36,7 @@ extern int failed_tests;
 
 cfg_t* create_cfg();
 processor_t* create_processor();
+processor_t* create_processor(reg_t mds, reg_t sids, reg_t entries);
 mmu_t* create_mmu(processor_t* proc);
 srcmd_csr_t_p get_srcmd(processor_t* proc, int srcmd_idx);
 mdcfg_csr_t_p get_mdcfg(processor_t* proc, int mdcfg_idx);
@@ -44,4 +46,6 @@ void store_paddr(entry_addr_csr_t_p entry_addr, reg_t paddr);
 void write_entry_cfg(processor_t* proc, int entry_cfg_idx, reg_t val);
 reg_t read_entry_cfg(processor_t* proc, int entry_cfg_idx);
 entrylck_csr_t_p get_entrylck(processor_t* proc);
+void randomize_iopmp(processor_t* proc, std::mt19937_64& rng, reg_t span);
+bool reference_iopmp_ok(processor_t* proc, reg_t sid, reg_t addr, reg_t len, access_type type);
 void end_test();
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include "common.h"
 #include <cstdint>
 #include <cstddef>
+#include <iosfwd>
 #include <string>
 #include <map>
 #include <stdexcept>
@@ -19,6 +20,11 @@ class abstract_device_t {
   virtual ~abstract_device_t() {}
   virtual void tick(reg_t UNUSED rtc_ticks) {}
 
+  // Write any state that a checkpoint must carry, and read it back in the
+  // same order on restore.  Devices without such state need not override.
+  virtual void save(std::ostream& UNUSED o) {}
+  virtual void restore(std::istream& UNUSED i) {}
+
  public:
   reg_t sid = UINT64_MAX;
 };
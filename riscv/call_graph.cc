@@ -0,0 +1,104 @@
+// See LICENSE for license details.
+
+#include "call_graph.h"
+#include "encoding.h"
+
+// Deeper stacks are not tracked further; their returns find no frame and
+// are ignored, like returns whose call was never seen
+#define CALL_GRAPH_MAX_DEPTH 1024
+
+static bool is_link(reg_t reg)
+{
+  return reg == 1 || reg == 5;
+}
+
+call_graph_t::call_graph_t()
+  : nodes(1), current(0)
+{
+  nodes[0].func = 0;
+  nodes[0].parent = 0;
+}
+
+void call_graph_t::jumped(insn_t insn, reg_t link, reg_t target)
+{
+  if (target == link)
+    return;
+
+  insn_bits_t bits = insn.bits();
+  if ((bits & 3) != 3) {
+    const unsigned quadrant = bits & 3, funct3 = (bits >> 13) & 7;
+    if (quadrant == 1 && funct3 == 1) // c.jal; on RV64 c.addiw, which never jumps
+      call(target, link, false);
+    else if (quadrant == 2 && funct3 == 4 && insn.rvc_rs2() == 0) {
+      if ((bits >> 12) & 1) // c.jalr
+        call(target, link, false);
+      else if (is_link(insn.rvc_rs1())) // c.jr
+        ret(target);
+    }
+    return;
+  }
+
+  switch (bits & 0x7f) {
+    case 0x6f: // jal
+      if (is_link(insn.rd()))
+        call(target, link, false);
+      break;
+    case 0x67: // jalr
+      if (is_link(insn.rd()))
+        call(target, link, false);
+      else if (insn.rd() == 0 && is_link(insn.rs1()))
+        ret(target);
+      break;
+    case 0x73: // SYSTEM
+      if (bits == MATCH_MRET || bits == MATCH_SRET || bits == MATCH_MNRET)
+        trap_ret();
+      break;
+  }
+}
+
+void call_graph_t::trapped(reg_t handler)
+{
+  call(handler, 0, true);
+}
+
+void call_graph_t::call(reg_t target, reg_t return_addr, bool trap)
+{
+  if (stack.size() == CALL_GRAPH_MAX_DEPTH)
+    return;
+  stack.push_back({current, return_addr, trap});
+
+  auto it = nodes[current].children.find(target);
+  if (it != nodes[current].children.end()) {
+    current = it->second;
+    return;
+  }
+  size_t child = nodes.size();
+  nodes.push_back({target, current, {}, {}});
+  nodes[current].children[target] = child;
+  current = child;
+}
+
+// Returns to the innermost caller that expects it, skipping frames that
+// were left without a return, e.g. by longjmp.  Handlers return by xRET, so
+// the search stops at the innermost trap frame.
+void call_graph_t::ret(reg_t target)
+{
+  for (size_t i = stack.size(); i-- > 0 && !stack[i].trap;) {
+    if (stack[i].return_addr == target) {
+      current = stack[i].node;
+      stack.resize(i);
+      return;
+    }
+  }
+}
+
+void call_graph_t::trap_ret()
+{
+  for (size_t i = stack.size(); i-- > 0;) {
+    if (stack[i].trap) {
+      current = stack[i].node;
+      stack.resize(i);
+      return;
+    }
+  }
+}
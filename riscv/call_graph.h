@@ -0,0 +1,56 @@
+// See LICENSE for license details.
+
+#ifndef _RISCV_CALL_GRAPH_H
+#define _RISCV_CALL_GRAPH_H
+
+#include "decode.h"
+#include <unordered_map>
+#include <vector>
+
+// The calling contexts a hart has run in, for --profile-calls.  A shadow
+// stack follows the calls and returns the hart makes, as told apart by the
+// ABI's use of the link registers: a jal or jalr that writes ra or t0 is a
+// call, a jalr to ra or t0 that writes no register is a return.  A trap
+// pushes a frame for its handler, which the xRET leaving the handler pops.
+//
+// Contexts form a tree whose root stands for the code that was running
+// before the first tracked call.  Each pc sample is charged to the current
+// context.  Tail calls are not calls, so their callees are charged to
+// their caller's context; the profile still names them as the leaf, by pc.
+class call_graph_t
+{
+public:
+  struct node_t {
+    reg_t func;    // entry point of the callee; 0 for the root
+    size_t parent;
+    std::unordered_map<reg_t, size_t> children; // by callee
+    std::unordered_map<reg_t, uint64_t> samples; // by pc
+  };
+
+  call_graph_t();
+
+  // The instruction insn, whose fall-through is link, went to target
+  void jumped(insn_t insn, reg_t link, reg_t target);
+  // A trap went to handler
+  void trapped(reg_t handler);
+  void sample(reg_t pc) { nodes[current].samples[pc]++; }
+
+  const std::vector<node_t>& get_nodes() const { return nodes; }
+
+private:
+  struct frame_t {
+    size_t node;        // context of the caller
+    reg_t return_addr;
+    bool trap;
+  };
+
+  void call(reg_t target, reg_t return_addr, bool trap);
+  void ret(reg_t target);
+  void trap_ret();
+
+  std::vector<node_t> nodes;
+  std::vector<frame_t> stack;
+  size_t current;
+};
+
+#endif
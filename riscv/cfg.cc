@@ -6,7 +6,13 @@
 #include "encoding.h"
 #include "platform.h"
 
-mem_cfg_t::mem_cfg_t(reg_t base, reg_t size) : base(base), size(size)
+mem_cfg_t::mem_cfg_t(reg_t base, reg_t size) : base(base), size(size), shared(false)
+{
+  assert(mem_cfg_t::check_if_supported(base, size));
+}
+
+mem_cfg_t::mem_cfg_t(reg_t base, reg_t size, const std::string& backing, bool shared)
+  : base(base), size(size), backing(backing), shared(shared)
 {
   assert(mem_cfg_t::check_if_supported(base, size));
 }
@@ -48,4 +54,16 @@ cfg_t::cfg_t()
   explicit_hartids = false;
   real_time_clint  = false;
   trigger_count    = 4;
+  jit              = false;
+  parallel         = parallel_none;
+  parallel_threads = 0;
+  tlb_entries      = 256;
+  tlb_ways         = 1;
+  tlb_policy       = tlb_policy_lru;
+  tlb_stats        = false;
+  checkpoint_at    = std::nullopt;
+  checkpoint_every = std::nullopt;
+  profile_interval = std::nullopt;
+  profile_calls    = false;
+  perf_interval    = std::nullopt;
 }
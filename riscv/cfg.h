@@ -3,6 +3,7 @@
 #define _RISCV_CFG_H
 
 #include <optional>
+#include <string>
 #include <vector>
 #include "decode.h"
 #include <cassert>
@@ -12,6 +13,17 @@ typedef enum {
   endianness_big
 } endianness_t;
 
+typedef enum {
+  parallel_none,           // all harts run on the simulation thread
+  parallel_deterministic,  // hart threads take turns in the sequential order
+  parallel_relaxed         // hart threads run their quanta concurrently
+} parallel_mode_t;
+
+typedef enum {
+  tlb_policy_lru,
+  tlb_policy_random
+} tlb_policy_t;
+
 template <typename T>
 class cfg_arg_t {
 public:
@@ -40,6 +52,7 @@ public:
   static bool check_if_supported(reg_t base, reg_t size);
 
   mem_cfg_t(reg_t base, reg_t size);
+  mem_cfg_t(reg_t base, reg_t size, const std::string& backing, bool shared);
 
   reg_t get_base() const {
     return base;
@@ -53,9 +66,21 @@ public:
     return base + size - 1;
   }
 
+  // File or shm:<name> object the region is mapped from; empty if anonymous
+  const std::string& get_backing() const {
+    return backing;
+  }
+
+  // Whether target writes go through to the backing object
+  bool is_shared() const {
+    return shared;
+  }
+
 private:
   reg_t base;
   reg_t size;
+  std::string backing;
+  bool shared;
 };
 
 class cfg_t
@@ -81,6 +106,23 @@ public:
   bool                    explicit_hartids;
   bool                    real_time_clint;
   reg_t                   trigger_count;
+  bool                    jit;
+  parallel_mode_t         parallel;
+  size_t                  parallel_threads;
+  size_t                  tlb_entries;
+  size_t                  tlb_ways;
+  tlb_policy_t            tlb_policy;
+  bool                    tlb_stats;
+  std::optional<reg_t>    checkpoint_at;
+  std::string             checkpoint_path;
+  std::optional<reg_t>    checkpoint_every;
+  std::string             checkpoint_prefix;
+  std::string             restore_path;
+  std::optional<reg_t>    profile_interval;
+  std::string             profile_path;
+  bool                    profile_calls;
+  std::optional<reg_t>    perf_interval;
+  std::string             perf_path;
 
   size_t nprocs() const { return hartids.size(); }
   size_t max_hartid() const { return hartids.back(); }
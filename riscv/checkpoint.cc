@@ -0,0 +1,263 @@
+// See LICENSE for license details.
+
+#include "sim.h"
+#include "checkpoint.h"
+#include "mmu.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+// A checkpoint holds the harts, then the devices, then for each memory the
+// runs of pages it holds.  The page data follows at a page-aligned offset,
+// so that restore can map it straight into flat memories.
+//
+// The first checkpoint of a run holds every non-zero page.  Later ones are
+// incremental: they name the previous checkpoint as their parent and hold
+// only the pages written since it was taken, which the MMU reports through
+// mem_written() whenever a store misses in its TLB.
+
+static const char checkpoint_magic[8] = {'s', 'p', 'i', 'k', 'e', 'c', 'k', '2'};
+
+struct page_run_t {
+  reg_t addr;
+  reg_t pages;
+};
+
+static bool page_is_zero(const char* page)
+{
+  static const char zero[PGSIZE] = {0};
+  return memcmp(page, zero, PGSIZE) == 0;
+}
+
+static void add_page(std::vector<page_run_t>& runs, reg_t addr)
+{
+  if (!runs.empty() && runs.back().addr + runs.back().pages * PGSIZE == addr)
+    runs.back().pages++;
+  else
+    runs.push_back({addr, 1});
+}
+
+static std::string dir_of(const std::string& path)
+{
+  auto slash = path.rfind('/');
+  return slash == std::string::npos ? "" : path.substr(0, slash + 1);
+}
+
+static void write_string(std::ostream& o, const std::string& s)
+{
+  checkpoint_write(o, s.size());
+  o.write(s.data(), s.size());
+}
+
+static std::string read_string(std::istream& i)
+{
+  std::string s(checkpoint_read<size_t>(i), '\0');
+  if (!i.read(s.data(), s.size()))
+    throw std::runtime_error("checkpoint is truncated");
+  return s;
+}
+
+// Reads the header of a checkpoint, leaving i just past it.  Returns the
+// path of the parent checkpoint, if any, and the offset of the memory runs.
+static std::string read_header(std::istream& i, const std::string& path, std::streamoff* mem_offset)
+{
+  char magic[sizeof(checkpoint_magic)];
+  if (!i.read(magic, sizeof(magic)) || memcmp(magic, checkpoint_magic, sizeof(magic)) != 0)
+    throw std::runtime_error(path + " is not a spike checkpoint");
+  std::string parent = read_string(i);
+  if (!parent.empty() && parent[0] != '/')
+    parent = dir_of(path) + parent;
+  checkpoint_read(i, *mem_offset);
+  return parent;
+}
+
+std::optional<reg_t> sim_t::next_checkpoint() const
+{
+  std::optional<reg_t> next;
+  if (cfg->checkpoint_at && *cfg->checkpoint_at > total_steps)
+    next = *cfg->checkpoint_at;
+  if (cfg->checkpoint_every) {
+    reg_t every = *cfg->checkpoint_every;
+    next = std::min(next.value_or(UINT64_MAX), (total_steps / every + 1) * every);
+  }
+  return next;
+}
+
+void sim_t::mem_written(reg_t paddr)
+{
+  if (dirty_pages.empty())
+    return;
+  for (size_t m = 0; m < mems.size(); m++) {
+    reg_t page = (paddr - mems[m].first) >> PGSHIFT;
+    if (paddr - mems[m].first < mems[m].second->size()) {
+      dirty_pages[m][page / 64].fetch_or(uint64_t(1) << (page % 64), std::memory_order_relaxed);
+      return;
+    }
+  }
+}
+
+// Starts a new set of dirty page bitmaps.  Stores that hit in a TLB are not
+// reported, so every TLB must miss once more on each page it writes.
+void sim_t::track_dirty_pages()
+{
+  dirty_pages.clear();
+  for (auto& mem : mems)
+    dirty_pages.emplace_back((mem.second->size() / PGSIZE + 63) / 64);
+  for (auto p : procs)
+    p->get_mmu()->flush_tlb();
+  debug_mmu->flush_tlb();
+}
+
+void sim_t::save_checkpoint(const std::string& path)
+{
+  std::ofstream o(path, std::ios::binary);
+  if (!o)
+    throw std::runtime_error("could not create checkpoint " + path);
+
+  const bool incremental = !dirty_pages.empty();
+  std::string parent = last_checkpoint;
+  if (dir_of(parent) == dir_of(path))
+    parent = parent.substr(dir_of(parent).size());
+
+  o.write(checkpoint_magic, sizeof(checkpoint_magic));
+  write_string(o, incremental ? parent : "");
+  const std::streamoff mem_offset_pos = o.tellp();
+  checkpoint_write(o, std::streamoff(0));
+  checkpoint_write(o, total_steps);
+  checkpoint_write(o, current_step);
+  checkpoint_write(o, current_proc);
+
+  checkpoint_write(o, procs.size());
+  for (auto p : procs)
+    p->save(o);
+  checkpoint_write(o, devices.size());
+  for (auto& dev : devices)
+    dev->save(o);
+
+  const std::streamoff mem_offset = o.tellp();
+  std::vector<std::vector<page_run_t>> runs(mems.size());
+  for (size_t m = 0; m < mems.size(); m++) {
+    abstract_mem_t* mem = mems[m].second;
+    if (incremental) {
+      auto& dirty = dirty_pages[m];
+      for (size_t w = 0; w < dirty.size(); w++)
+        for (uint64_t bits = dirty[w].exchange(0); bits; bits &= bits - 1)
+          add_page(runs[m], (w * 64 + __builtin_ctzll(bits)) << PGSHIFT);
+    } else {
+      mem->for_each_page([&](reg_t addr) {
+        if (!page_is_zero(mem->contents(addr)))
+          add_page(runs[m], addr);
+      });
+    }
+
+    checkpoint_write(o, mems[m].first);
+    checkpoint_write(o, mem->size());
+    checkpoint_write(o, runs[m].size());
+    for (auto& r : runs[m])
+      checkpoint_write(o, r);
+  }
+
+  std::vector<char> pad((PGSIZE - o.tellp() % PGSIZE) % PGSIZE, 0);
+  o.write(pad.data(), pad.size());
+  for (size_t m = 0; m < mems.size(); m++)
+    for (auto& r : runs[m])
+      o.write(mems[m].second->contents(r.addr), r.pages * PGSIZE);
+
+  o.seekp(mem_offset_pos);
+  checkpoint_write(o, mem_offset);
+  if (!o.flush())
+    throw std::runtime_error("could not write checkpoint " + path);
+
+  if (cfg->checkpoint_every)
+    track_dirty_pages();
+  last_checkpoint = path;
+
+  size_t pages = 0;
+  for (auto& r : runs)
+    for (auto& run : r)
+      pages += run.pages;
+  std::cerr << "Saved " << (incremental ? "incremental " : "") << "checkpoint " << path
+            << " with " << pages << " pages after " << total_steps << " instructions\n";
+}
+
+void sim_t::restore_checkpoint(const std::string& path)
+{
+  std::ifstream i(path, std::ios::binary);
+  std::streamoff mem_offset;
+  read_header(i, path, &mem_offset);
+  checkpoint_read(i, total_steps);
+  checkpoint_read(i, current_step);
+  checkpoint_read(i, current_proc);
+
+  if (checkpoint_read<size_t>(i) != procs.size())
+    throw std::runtime_error("checkpoint has a different number of harts");
+  for (auto p : procs)
+    p->restore(i);
+  if (checkpoint_read<size_t>(i) != devices.size())
+    throw std::runtime_error("checkpoint has a different set of devices");
+  for (auto& dev : devices)
+    dev->restore(i);
+
+  // Whatever was loaded before the restore must not show through
+  for (auto& [base, mem] : mems) {
+    mem->for_each_page([&](reg_t addr) {
+      char* page = mem->contents(addr);
+      if (!page_is_zero(page))
+        memset(page, 0, PGSIZE);
+    });
+  }
+  restore_checkpoint_memory(path);
+
+  for (auto p : procs)
+    p->get_mmu()->flush_icache();
+
+  // Periodic checkpoints of the resumed run build on this one
+  last_checkpoint = path;
+  if (cfg->checkpoint_every)
+    track_dirty_pages();
+}
+
+// Maps or copies in the pages of the checkpoint at path, after those of
+// the checkpoints it was taken relative to
+void sim_t::restore_checkpoint_memory(const std::string& path)
+{
+  std::ifstream i(path, std::ios::binary);
+  std::streamoff mem_offset;
+  std::string parent = read_header(i, path, &mem_offset);
+  if (!parent.empty())
+    restore_checkpoint_memory(parent);
+
+  i.seekg(mem_offset);
+  std::vector<std::vector<page_run_t>> runs(mems.size());
+  for (size_t m = 0; m < mems.size(); m++) {
+    if (checkpoint_read<reg_t>(i) != mems[m].first || checkpoint_read<reg_t>(i) != mems[m].second->size())
+      throw std::runtime_error("checkpoint has a different memory layout");
+    runs[m].resize(checkpoint_read<size_t>(i));
+    for (auto& r : runs[m])
+      checkpoint_read(i, r);
+  }
+
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("could not open checkpoint " + path);
+  off_t offset = (i.tellg() + off_t(PGSIZE - 1)) / PGSIZE * PGSIZE;
+  for (size_t m = 0; m < mems.size(); m++) {
+    abstract_mem_t* mem = mems[m].second;
+    auto flat = dynamic_cast<flat_mem_t*>(mem);
+    for (auto& r : runs[m]) {
+      const reg_t len = r.pages * PGSIZE;
+      if (!flat || !flat->map_file(r.addr, len, fd, offset)) {
+        for (reg_t p = 0; p < len; p += PGSIZE) {
+          if (pread(fd, mem->contents(r.addr + p), PGSIZE, offset + p) != (ssize_t)PGSIZE) {
+            close(fd);
+            throw std::runtime_error("checkpoint is truncated");
+          }
+        }
+      }
+      offset += len;
+    }
+  }
+  close(fd);
+}
@@ -0,0 +1,35 @@
+// See LICENSE for license details.
+
+#ifndef _RISCV_CHECKPOINT_H
+#define _RISCV_CHECKPOINT_H
+
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+
+// Fields of a checkpoint are stored as raw host-endian values.  A checkpoint
+// can only be restored by the same build of spike, run with the same
+// options and target program as the run that saved it.
+
+template<typename T>
+static inline void checkpoint_write(std::ostream& o, const T& x)
+{
+  o.write(reinterpret_cast<const char*>(&x), sizeof(x));
+}
+
+template<typename T>
+static inline void checkpoint_read(std::istream& i, T& x)
+{
+  if (!i.read(reinterpret_cast<char*>(&x), sizeof(x)))
+    throw std::runtime_error("checkpoint is truncated");
+}
+
+template<typename T>
+static inline T checkpoint_read(std::istream& i)
+{
+  T x;
+  checkpoint_read(i, x);
+  return x;
+}
+
+#endif
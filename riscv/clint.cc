@@ -5,6 +5,7 @@
 #include "simif.h"
 #include "sim.h"
 #include "dts.h"
+#include "checkpoint.h"
 
 clint_t::clint_t(const simif_t* sim, uint64_t freq_hz, bool real_time)
   : sim(sim), freq_hz(freq_hz), real_time(real_time), mtime(0)
@@ -116,6 +117,36 @@ void clint_t::tick(reg_t rtc_ticks)
   }
 }
 
+void clint_t::save(std::ostream& o)
+{
+  checkpoint_write(o, mtime);
+  checkpoint_write(o, mtimecmp.size());
+  for (const auto& [hart_id, cmp] : mtimecmp) {
+    checkpoint_write(o, hart_id);
+    checkpoint_write(o, cmp);
+  }
+}
+
+void clint_t::restore(std::istream& i)
+{
+  checkpoint_read(i, mtime);
+  mtimecmp.clear();
+  for (size_t n = checkpoint_read<size_t>(i); n > 0; n--) {
+    const size_t hart_id = checkpoint_read<size_t>(i);
+    checkpoint_read(i, mtimecmp[hart_id]);
+  }
+
+  if (real_time) {
+    // Carry on from the saved time rather than from the time of day
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    uint64_t usecs = now.tv_sec * 1000000 + now.tv_usec - mtime * 1000000 / freq_hz;
+    real_time_ref_secs = usecs / 1000000;
+    real_time_ref_usecs = usecs % 1000000;
+  }
+  tick(0);
+}
+
 clint_t* clint_parse_from_fdt(const void* fdt, const sim_t* sim, reg_t* base,
     const std::vector<std::string>& sargs) {
   if (fdt_parse_clint(fdt, base, "riscv,clint0") == 0 || fdt_parse_clint(fdt, base, "sifive,clint0") == 0)
@@ -0,0 +1,225 @@
+// See LICENSE for license details.
+
+#include "commit_log.h"
+#include "disasm.h"
+#include <cassert>
+#include <cinttypes>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#define COMMIT_LOG_CHUNKS        4
+#define COMMIT_LOG_CHUNK_RECORDS 32768
+
+static void commit_log_print_value(FILE *log_file, int width, const void *data)
+{
+  assert(log_file);
+
+  switch (width) {
+    case 8:
+      fprintf(log_file, "0x%02" PRIx8, *(const uint8_t *)data);
+      break;
+    case 16:
+      fprintf(log_file, "0x%04" PRIx16, *(const uint16_t *)data);
+      break;
+    case 32:
+      fprintf(log_file, "0x%08" PRIx32, *(const uint32_t *)data);
+      break;
+    case 64:
+      fprintf(log_file, "0x%016" PRIx64, *(const uint64_t *)data);
+      break;
+    default:
+      // max lengh of vector
+      if (((width - 1) & width) == 0) {
+        const uint64_t *arr = (const uint64_t *)data;
+
+        fprintf(log_file, "0x");
+        for (int idx = width / 64 - 1; idx >= 0; --idx) {
+          fprintf(log_file, "%016" PRIx64, arr[idx]);
+        }
+      } else {
+        abort();
+      }
+      break;
+  }
+}
+
+static void commit_log_print_value(FILE *log_file, int width, uint64_t val)
+{
+  commit_log_print_value(log_file, width, &val);
+}
+
+void commit_log_print(FILE *log_file, const commit_log_record_t *r, size_t n)
+{
+  assert(n > 0 && r[0].type == COMMIT_LOG_INSN);
+  const commit_log_record_t &insn = r[0];
+  int xlen = insn.xlen;
+  int flen = insn.flen;
+
+  // print core id on all lines so it is easy to grep
+  fprintf(log_file, "core%4" PRId32 ": ", insn.hart);
+
+  fprintf(log_file, "%1d ", insn.size);
+  commit_log_print_value(log_file, xlen, insn.addr);
+  fprintf(log_file, " (");
+  commit_log_print_value(log_file, insn.data[1] * 8, insn.data[0]);
+  fprintf(log_file, ")");
+
+  for (size_t i = 1; i < n; i++) {
+    const commit_log_record_t &item = r[i];
+    switch (item.type) {
+      case COMMIT_LOG_VTYPE: {
+        long lmul = (int64_t)item.data[1];
+        fprintf(log_file, " e%ld %s%ld l%ld",
+                (long)item.data[0], lmul < 0 ? "mf" : "m", lmul < 0 ? -lmul : lmul, (long)item.addr);
+        break;
+      }
+      case COMMIT_LOG_REG: {
+        int rd = item.addr >> 4;
+        switch (item.addr & 0xf) {
+          case 0:
+            fprintf(log_file, " x%-2d ", rd);
+            commit_log_print_value(log_file, xlen, item.data);
+            break;
+          case 1:
+            fprintf(log_file, " f%-2d ", rd);
+            commit_log_print_value(log_file, flen, item.data);
+            break;
+          case 2: {
+            // The register contents follow in VREG_DATA records
+            std::vector<uint64_t> words;
+            while (i + 1 < n && r[i + 1].type == COMMIT_LOG_VREG_DATA) {
+              words.push_back(r[++i].data[0]);
+              words.push_back(r[i].data[1]);
+            }
+            fprintf(log_file, " v%-2d ", rd);
+            commit_log_print_value(log_file, item.data[0], words.data());
+            break;
+          }
+          case 4:
+            fprintf(log_file, " c%d_%s ", rd, csr_name(rd));
+            commit_log_print_value(log_file, xlen, item.data);
+            break;
+          default:
+            assert("can't been here" && 0);
+            break;
+        }
+        break;
+      }
+      case COMMIT_LOG_LOAD:
+        fprintf(log_file, " mem ");
+        commit_log_print_value(log_file, xlen, item.addr);
+        break;
+      case COMMIT_LOG_STORE:
+        fprintf(log_file, " mem ");
+        commit_log_print_value(log_file, xlen, item.addr);
+        fprintf(log_file, " ");
+        commit_log_print_value(log_file, item.size << 3, item.data[0]);
+        break;
+    }
+  }
+  fprintf(log_file, "\n");
+}
+
+// Returns the command that compresses to, or decompresses from, path, if
+// its extension names a compressor
+static std::string compressor(const char* path, bool decompress)
+{
+  static const struct { const char* ext; const char* cmd; } compressors[] = {
+    {".zst", "zstd -q"},
+    {".lz4", "lz4 -q"},
+    {".gz", "gzip"},
+  };
+  size_t len = strlen(path);
+  for (auto& c : compressors) {
+    size_t ext_len = strlen(c.ext);
+    if (len > ext_len && strcmp(path + len - ext_len, c.ext) == 0)
+      return std::string(c.cmd) + (decompress ? " -dc '" : " -c > '") + path + "'";
+  }
+  return "";
+}
+
+commit_log_writer_t::commit_log_writer_t(const char* path)
+  : chunks(COMMIT_LOG_CHUNKS), tail(0), head(0), full(0), exiting(false)
+{
+  std::string cmd = compressor(path, false);
+  piped = !cmd.empty();
+  file = piped ? popen(cmd.c_str(), "w") : fopen(path, "w");
+  if (!file)
+    throw std::runtime_error(std::string("could not create commit log ") + path);
+  fwrite(COMMIT_LOG_MAGIC, 1, strlen(COMMIT_LOG_MAGIC), file);
+
+  for (auto& chunk : chunks)
+    chunk.reserve(COMMIT_LOG_CHUNK_RECORDS);
+  writer = std::thread(&commit_log_writer_t::drain, this);
+}
+
+commit_log_writer_t::~commit_log_writer_t()
+{
+  submit();
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    exiting = true;
+  }
+  chunk_full.notify_one();
+  writer.join();
+  piped ? pclose(file) : fclose(file);
+}
+
+void commit_log_writer_t::write(const commit_log_record_t* r, size_t n)
+{
+  if (chunks[tail].size() + n > COMMIT_LOG_CHUNK_RECORDS)
+    submit();
+  chunks[tail].insert(chunks[tail].end(), r, r + n);
+}
+
+// Hands the chunk being filled to the writer thread, then waits for the
+// next one to be free
+void commit_log_writer_t::submit()
+{
+  if (chunks[tail].empty())
+    return;
+  std::unique_lock<std::mutex> guard(lock);
+  tail = (tail + 1) % COMMIT_LOG_CHUNKS;
+  full++;
+  chunk_full.notify_one();
+  chunk_free.wait(guard, [&] { return full < COMMIT_LOG_CHUNKS; });
+}
+
+void commit_log_writer_t::drain()
+{
+  std::unique_lock<std::mutex> guard(lock);
+  while (true) {
+    chunk_full.wait(guard, [&] { return full > 0 || exiting; });
+    if (full == 0)
+      return;
+
+    // The simulation does not touch full chunks, so this one can be
+    // written out without holding the lock
+    auto& chunk = chunks[head];
+    guard.unlock();
+    fwrite(chunk.data(), sizeof(commit_log_record_t), chunk.size(), file);
+    chunk.clear();
+    guard.lock();
+
+    head = (head + 1) % COMMIT_LOG_CHUNKS;
+    full--;
+    chunk_free.notify_one();
+  }
+}
+
+FILE* commit_log_open(const char* path, bool* piped)
+{
+  std::string cmd = compressor(path, true);
+  *piped = !cmd.empty();
+  FILE* file = *piped ? popen(cmd.c_str(), "r") : fopen(path, "r");
+  if (!file)
+    return NULL;
+
+  char magic[sizeof(COMMIT_LOG_MAGIC) - 1];
+  if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) || memcmp(magic, COMMIT_LOG_MAGIC, sizeof(magic)) != 0) {
+    *piped ? pclose(file) : fclose(file);
+    return NULL;
+  }
+  return file;
+}
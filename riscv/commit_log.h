@@ -0,0 +1,81 @@
+// See LICENSE for license details.
+
+#ifndef _RISCV_COMMIT_LOG_H
+#define _RISCV_COMMIT_LOG_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A commit log is a sequence of fixed-size records.  Each instruction
+// contributes a COMMIT_LOG_INSN record followed by the records of its
+// register writes and memory accesses, in the order the text log prints
+// them.  commit_log_print turns the records of one instruction into the
+// line --log-commits prints for it, so a binary log written with
+// --log-commits-binary can be decoded into the same text by spike-log-decode.
+
+#define COMMIT_LOG_MAGIC "spikecl1"
+
+enum commit_log_record_type_t : uint8_t {
+  COMMIT_LOG_INSN,      // addr = pc, data = {instruction bits, length in bytes}
+  COMMIT_LOG_VTYPE,     // addr = vl, data = {SEW, LMUL, negated if fractional}
+  COMMIT_LOG_REG,       // addr = register key as in state_t::log_reg_write,
+                        // data = value, or {VLEN} for a vector register
+  COMMIT_LOG_VREG_DATA, // data = the next 16 bytes of the vector register
+  COMMIT_LOG_LOAD,      // addr = address
+  COMMIT_LOG_STORE,     // addr = address, data = {value}
+};
+
+struct commit_log_record_t {
+  uint8_t type;
+  uint8_t size;         // INSN: privilege; LOAD and STORE: bytes accessed
+  uint8_t xlen;         // INSN only
+  uint8_t flen;         // INSN only
+  uint32_t hart;        // INSN only
+  uint64_t addr;
+  uint64_t data[2];
+};
+
+static_assert(sizeof(commit_log_record_t) == 32, "commit log records are 32 bytes");
+
+// Prints the text log line of the instruction whose records are [r, r + n)
+void commit_log_print(FILE* log_file, const commit_log_record_t* r, size_t n);
+
+// Writes records to a file from a background thread.  Records are gathered
+// in a ring of chunks: the simulation fills one while the writer thread
+// drains the full ones, so the simulation only waits when the file cannot
+// keep up.  Paths ending in .zst, .lz4 or .gz are piped through the
+// corresponding compressor.  Harts log one at a time, as --parallel=relaxed
+// refuses --log-commits, so write() is not thread-safe.
+class commit_log_writer_t
+{
+public:
+  commit_log_writer_t(const char* path);
+  ~commit_log_writer_t();
+
+  void write(const commit_log_record_t* r, size_t n);
+
+private:
+  void submit();
+  void drain();
+
+  FILE* file;
+  bool piped;
+  std::vector<std::vector<commit_log_record_t>> chunks;
+  size_t tail;        // the chunk being filled, owned by the simulation
+  size_t head, full;  // chunks [head, head + full) await the writer thread
+  bool exiting;
+  std::mutex lock;
+  std::condition_variable chunk_full;
+  std::condition_variable chunk_free;
+  std::thread writer;
+};
+
+// Opens a possibly compressed commit log for reading, as the writer would
+// have written it, and checks its magic.  Returns NULL on failure.
+FILE* commit_log_open(const char* path, bool* piped);
+
+#endif
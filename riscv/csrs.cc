@@ -302,6 +302,7 @@ bool srcmd_csr_t::unlogged_write(const reg_t val) noexcept {
       reg_t mask = (static_cast<reg_t>(1) << (shift_amount - 1) << 1) - 1;
       // If it is, write the value to the CSR
       this->val = val & mask;
+      state->iopmp_index.invalidate();
       return true;
     }
   }
@@ -370,6 +371,7 @@ bool mdcfg_csr_t::unlogged_write(const reg_t val) noexcept {
       // Write the value to the CSR, bits MDCFG_RSV must be zero on write
       // Specified in section 5.5: MDCFG Table, of the RISC-V IOPMP specification (Version 1.0.0-draft5)
       this->val = val & ~MDCFG_RSV;
+      state->iopmp_index.invalidate();
       return true;
     }
   }
@@ -470,6 +472,7 @@ bool entry_addr_csr_t::unlogged_write(const reg_t val) noexcept {
 
     if (!locked) {
       this->val = val;
+      state->iopmp_index.invalidate();
       return true;
     }
   }
@@ -494,31 +497,38 @@ reg_t entry_addr_csr_t::tor_base_paddr() const noexcept {
 
 // Checks if the entry matches the address range
 bool entry_addr_csr_t::match(reg_t addr, reg_t len) const noexcept {
-  const reg_t cfg_val = cfg->read();
+  reg_t base, top;
+  // All bytes of the transaction must lie within the range of the entry
+  return range(&base, &top) && base <= addr && addr + len - 1 < top;
+}
 
+// Returns the address range matched by the entry, if it is enabled
+bool entry_addr_csr_t::range(reg_t* base, reg_t* top) const noexcept {
   // Extract the address mode from the configuration
-  const reg_t cfga  = cfg_val & ENTRY_CFG_A;
-  const bool is_off = cfga == ENTRY_CFG_OFF;
-  const bool is_tor = cfga == ENTRY_CFG_TOR;
+  const reg_t cfga = cfg->read() & ENTRY_CFG_A;
 
-  bool matches = false;
   // When the a field is 0, the entry is disabled and does not match any address range
   // Specified in section 3.6.1 Physical Memory Protection CSRs, of the RISC-V Instruction Set Manual (Volume II)
-  if (is_off) 
-    matches = false;
-  // Top of range address mode
-  if (is_tor) {
-    reg_t tor_base_addr         = tor_base_paddr();
-    reg_t tor_top_addr          = tor_paddr();
-    reg_t transaction_base_addr = addr;
-    reg_t transaction_top_addr  = addr + len - 1;
-    // The entry matches any address in the range: entry_addr(i−1) ≤ a < entry_addr(i)
-    // Specified in section 3.6.1 Physical Memory Protection CSRs, of the RISC-V Instruction Set Manual (Volume II)
-    matches = tor_base_addr <= transaction_base_addr && 
-              transaction_top_addr < tor_top_addr;
+  if (cfga == ENTRY_CFG_OFF)
+    return false;
+
+  // Top of range address mode, the entry matches any address in the range: entry_addr(i−1) ≤ a < entry_addr(i)
+  // Specified in section 3.6.1 Physical Memory Protection CSRs, of the RISC-V Instruction Set Manual (Volume II)
+  if (cfga == ENTRY_CFG_TOR) {
+    *base = tor_base_paddr();
+    *top  = tor_paddr();
+    return true;
   }
-  
-  return matches;
+
+  // Naturally aligned four-byte region, or naturally aligned power-of-two
+  // region of 2^(k+3) bytes when the address field ends in k ones
+  // Specified in section 3.6.1 Physical Memory Protection CSRs, of the RISC-V Instruction Set Manual (Volume II)
+  const reg_t ones = cfga == ENTRY_CFG_NA4 ? 0 : val ^ (val + 1);
+  const reg_t size_minus_1 = (ones << ENTRY_ADDR_SHIFT) | ((1 << ENTRY_ADDR_SHIFT) - 1);
+  *base = (val & ~ones) << ENTRY_ADDR_SHIFT;
+  // A region that reaches the end of the address space stops one byte short of it
+  *top  = *base + std::min(size_minus_1, ~*base - 1) + 1;
+  return true;
 }
 
 // Checks if the access type is allowed by the entry
@@ -565,6 +575,7 @@ bool entry_cfg_csr_t::unlogged_write(const reg_t val) noexcept {
       // Bits ENTRY_CFG_RSV must be zero on write
       // Specified in section 5.7: Entry Array Registers, of the RISC-V IOPMP specification (Version 1.0.0-draft5)
       this->val = val & ~ENTRY_CFG_RSV;
+      state->iopmp_index.invalidate();
       return true;
     }
   }
@@ -762,7 +773,7 @@ void base_status_csr_t::maybe_flush_tlb(const reg_t newval) noexcept {
       (MSTATUS_MPP | MSTATUS_MPRV
        | (has_page ? (MSTATUS_MXR | MSTATUS_SUM) : 0)
       ))
-    proc->get_mmu()->flush_tlb();
+    proc->get_mmu()->switch_tlb_context();
 }
 
 namespace {
@@ -1050,6 +1061,10 @@ bool misa_csr_t::unlogged_write(const reg_t val) noexcept {
     }
   }
 
+  // Code compiled by the JIT elides the M and C extension checks.
+  if (new_misa != old_misa)
+    proc->get_mmu()->flush_icache();
+
   return basic_csr_t::unlogged_write(new_misa);
 }
 
@@ -1292,7 +1307,7 @@ base_atp_csr_t::base_atp_csr_t(processor_t* const proc, const reg_t addr):
 bool base_atp_csr_t::unlogged_write(const reg_t val) noexcept {
   const reg_t newval = proc->supports_impl(IMPL_MMU) ? compute_new_satp(val) : 0;
   if (newval != read())
-    proc->get_mmu()->flush_tlb();
+    proc->get_mmu()->switch_tlb_context();
   return basic_csr_t::unlogged_write(newval);
 }
 
@@ -1534,7 +1549,7 @@ void hgatp_csr_t::verify_permissions(insn_t insn, bool write) const {
 }
 
 bool hgatp_csr_t::unlogged_write(const reg_t val) noexcept {
-  proc->get_mmu()->flush_tlb();
+  proc->get_mmu()->switch_tlb_context();
 
   reg_t mask;
   if (proc->get_const_xlen() == 32) {
@@ -198,6 +198,9 @@ class entry_addr_csr_t: public csr_t {
 
   bool match(reg_t addr, reg_t len) const noexcept;
 
+  // Whether the entry is enabled, and if so the range [*base, *top) it matches
+  bool range(reg_t* base, reg_t* top) const noexcept;
+
   bool access_ok(access_type type) const noexcept;
 
  protected:
@@ -1,6 +1,17 @@
 #include "devices.h"
 #include "mmu.h"
 #include <stdexcept>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
 
 mmio_device_map_t& mmio_device_map()
 {
@@ -57,6 +68,12 @@ std::pair<reg_t, abstract_device_t*> bus_t::find_device(reg_t addr)
   return std::make_pair(it->first, it->second);
 }
 
+void abstract_mem_t::for_each_page(const std::function<void(reg_t)>& visit)
+{
+  for (reg_t addr = 0; addr < size(); addr += PGSIZE)
+    visit(addr);
+}
+
 mem_t::mem_t(reg_t size)
   : sz(size)
 {
@@ -93,6 +110,7 @@ bool mem_t::load_store(reg_t addr, size_t len, uint8_t* bytes, bool store)
 
 char* mem_t::contents(reg_t addr) {
   reg_t ppn = addr >> PGSHIFT, pgoff = addr % PGSIZE;
+  std::lock_guard<std::mutex> guard(sparse_memory_lock);
   auto search = sparse_memory_map.find(ppn);
   if (search == sparse_memory_map.end()) {
     auto res = (char*)calloc(PGSIZE, 1);
@@ -116,3 +134,116 @@ void mem_t::dump(std::ostream& o) {
     }
   }
 }
+
+void mem_t::for_each_page(const std::function<void(reg_t)>& visit)
+{
+  std::vector<reg_t> pages;
+  {
+    std::lock_guard<std::mutex> guard(sparse_memory_lock);
+    for (const auto& [ppn, page] : sparse_memory_map)
+      pages.push_back(ppn << PGSHIFT);
+  }
+  for (reg_t addr : pages)
+    visit(addr);
+}
+
+flat_mem_t::flat_mem_t(reg_t size)
+  : sz(size), anonymous(true), shared(false)
+{
+  if (size == 0 || size % PGSIZE != 0)
+    throw std::runtime_error("memory size must be a positive multiple of 4 KiB");
+
+  void* p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (p == MAP_FAILED)
+    throw std::runtime_error("could not reserve " + std::to_string(size >> 20) +
+                             " MiB of host address space for memory; try --sparse-mem");
+  data = (char*)p;
+}
+
+flat_mem_t::flat_mem_t(reg_t size, const std::string& backing, bool shared)
+  : flat_mem_t(size)
+{
+  this->anonymous = false;
+  this->shared = shared;
+
+  int fd;
+  if (backing.compare(0, 4, "shm:") == 0)
+    fd = shm_open(backing.c_str() + 4, O_RDWR | O_CREAT, 0600);
+  else
+    fd = open(backing.c_str(), shared ? O_RDWR : O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("could not open memory backing " + backing + ": " + strerror(errno));
+
+  // A shared object is grown to cover the region, so that every target
+  // store lands in it.  A private mapping only covers the existing file;
+  // the rest of the region stays anonymous zero-filled memory.
+  struct stat st;
+  reg_t backing_size = fstat(fd, &st) == 0 ? st.st_size : 0;
+  if (shared && backing_size < size && ftruncate(fd, size) == 0)
+    backing_size = size;
+
+  reg_t map_size = std::min(size, (backing_size + PGSIZE - 1) / PGSIZE * PGSIZE);
+  void* p = map_size == 0 ? data :
+    mmap(data, map_size, PROT_READ | PROT_WRITE,
+         (shared ? MAP_SHARED : MAP_PRIVATE) | MAP_FIXED, fd, 0);
+  int map_errno = errno;
+  close(fd);
+  if (p == MAP_FAILED)
+    throw std::runtime_error("could not map memory backing " + backing + ": " + strerror(map_errno));
+}
+
+flat_mem_t::~flat_mem_t()
+{
+  munmap(data, sz);
+}
+
+bool flat_mem_t::load(reg_t addr, size_t len, uint8_t* bytes)
+{
+  if (addr + len < addr || addr + len > sz)
+    return false;
+  memcpy(bytes, data + addr, len);
+  return true;
+}
+
+bool flat_mem_t::store(reg_t addr, size_t len, const uint8_t* bytes)
+{
+  if (addr + len < addr || addr + len > sz)
+    return false;
+  memcpy(data + addr, bytes, len);
+  return true;
+}
+
+void flat_mem_t::dump(std::ostream& o) {
+  o.write(data, sz);
+}
+
+void flat_mem_t::for_each_page(const std::function<void(reg_t)>& visit)
+{
+  if (!anonymous)
+    return abstract_mem_t::for_each_page(visit);
+
+  // Pages of an anonymous mapping that the host has never backed are zero
+  const size_t chunk = 1024;
+#ifdef __APPLE__
+  char resident[chunk];
+#else
+  unsigned char resident[chunk];
+#endif
+  for (reg_t addr = 0; addr < sz; addr += chunk * PGSIZE) {
+    reg_t len = std::min(reg_t(chunk * PGSIZE), sz - addr);
+    bool ok = mincore(data + addr, len, resident) == 0;
+    for (reg_t i = 0; i < len / PGSIZE; i++)
+      if (!ok || (resident[i] & 1))
+        visit(addr + i * PGSIZE);
+  }
+}
+
+bool flat_mem_t::map_file(reg_t addr, reg_t len, int fd, off_t offset)
+{
+  if (shared)
+    return false;
+  anonymous = false;
+  return mmap(data + addr, len, PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_FIXED, fd, offset) != MAP_FAILED;
+}
@@ -5,7 +5,9 @@
 #include "abstract_device.h"
 #include "abstract_interrupt_controller.h"
 #include "platform.h"
+#include <functional>
 #include <map>
+#include <mutex>
 #include <queue>
 #include <vector>
 #include <utility>
@@ -43,6 +45,8 @@ class abstract_mem_t : public abstract_device_t {
   virtual char* contents(reg_t addr) = 0;
   virtual reg_t size() = 0;
   virtual void dump(std::ostream& o) = 0;
+  // Calls visit(addr) for each page that may hold non-zero data
+  virtual void for_each_page(const std::function<void(reg_t)>& visit);
 };
 
 class mem_t : public abstract_mem_t {
@@ -56,14 +60,48 @@ class mem_t : public abstract_mem_t {
   char* contents(reg_t addr) override;
   reg_t size() override { return sz; }
   void dump(std::ostream& o) override;
+  void for_each_page(const std::function<void(reg_t)>& visit) override;
 
  private:
   bool load_store(reg_t addr, size_t len, uint8_t* bytes, bool store);
 
   std::map<reg_t, char*> sparse_memory_map;
+  std::mutex sparse_memory_lock; // pages are allocated by concurrent hart threads
   reg_t sz;
 };
 
+// Memory backed by a single host mapping reserved up front.  The host
+// kernel supplies zero pages on first touch, so untouched memory costs
+// nothing, and guest-to-host translation is an offset from host_base().
+class flat_mem_t : public abstract_mem_t {
+ public:
+  flat_mem_t(reg_t size);
+  // Map the start of the region from a file, or from a POSIX shared memory
+  // object if backing is shm:<name>.  Private mappings are copy-on-write;
+  // shared ones write through, so other processes see the target's stores.
+  flat_mem_t(reg_t size, const std::string& backing, bool shared);
+  flat_mem_t(const flat_mem_t& that) = delete;
+  ~flat_mem_t() override;
+
+  bool load(reg_t addr, size_t len, uint8_t* bytes) override;
+  bool store(reg_t addr, size_t len, const uint8_t* bytes) override;
+  char* contents(reg_t addr) override { return data + addr; }
+  reg_t size() override { return sz; }
+  void dump(std::ostream& o) override;
+  void for_each_page(const std::function<void(reg_t)>& visit) override;
+
+  char* host_base() { return data; }
+  // Replace [addr, addr + len) with a private mapping of fd at offset.
+  // Fails for shared regions, whose contents must reach the backing object.
+  bool map_file(reg_t addr, reg_t len, int fd, off_t offset);
+
+ private:
+  char* data;
+  reg_t sz;
+  bool anonymous;
+  bool shared;
+};
+
 class clint_t : public abstract_device_t {
  public:
   clint_t(const simif_t*, uint64_t freq_hz, bool real_time);
@@ -71,6 +109,8 @@ class clint_t : public abstract_device_t {
   bool store(reg_t addr, size_t len, const uint8_t* bytes) override;
   size_t size() { return CLINT_SIZE; }
   void tick(reg_t rtc_ticks) override;
+  void save(std::ostream& o) override;
+  void restore(std::istream& i) override;
   uint64_t get_mtimecmp(reg_t hartid) { return mtimecmp[hartid]; }
   uint64_t get_mtime() { return mtime; }
  private:
@@ -109,6 +149,8 @@ class plic_t : public abstract_device_t, public abstract_interrupt_controller_t
   bool load(reg_t addr, size_t len, uint8_t* bytes) override;
   bool store(reg_t addr, size_t len, const uint8_t* bytes) override;
   void set_interrupt_level(uint32_t id, int lvl) override;
+  void save(std::ostream& o) override;
+  void restore(std::istream& i) override;
   size_t size() { return PLIC_SIZE; }
  private:
   std::vector<plic_context_t> contexts;
@@ -140,6 +182,8 @@ class ns16550_t : public abstract_device_t {
   bool load(reg_t addr, size_t len, uint8_t* bytes) override;
   bool store(reg_t addr, size_t len, const uint8_t* bytes) override;
   void tick(reg_t rtc_ticks) override;
+  void save(std::ostream& o) override;
+  void restore(std::istream& i) override;
   size_t size() { return NS16550_SIZE; }
  private:
   abstract_interrupt_controller_t *intctrl;
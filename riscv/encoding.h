@@ -328,6 +328,8 @@
 #define ENTRY_CFG_RSV   0xFFFFFFFFFFFFFFE0
 #define ENTRY_CFG_OFF   0
 #define ENTRY_CFG_TOR   0x08
+#define ENTRY_CFG_NA4   0x10
+#define ENTRY_CFG_NAPOT 0x18
 
 #define ENTRYLCK_L        0x1
 #define ENTRYLCK_F        0x1FFFE
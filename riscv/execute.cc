@@ -3,9 +3,12 @@
 #include "config.h"
 #include "processor.h"
 #include "mmu.h"
+#include "jit.h"
 #include "disasm.h"
 #include "decode_macros.h"
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 
 static void commit_log_reset(processor_t* p)
 {
@@ -22,133 +25,98 @@ static void commit_log_stash_privilege(processor_t* p)
   state->last_inst_flen = p->get_flen();
 }
 
-static void commit_log_print_value(FILE *log_file, int width, const void *data)
+// Turns what the instruction just executed logged into commit log records
+static void commit_log_capture(processor_t *p, reg_t pc, insn_t insn)
 {
-  assert(log_file);
-
-  switch (width) {
-    case 8:
-      fprintf(log_file, "0x%02" PRIx8, *(const uint8_t *)data);
-      break;
-    case 16:
-      fprintf(log_file, "0x%04" PRIx16, *(const uint16_t *)data);
-      break;
-    case 32:
-      fprintf(log_file, "0x%08" PRIx32, *(const uint32_t *)data);
-      break;
-    case 64:
-      fprintf(log_file, "0x%016" PRIx64, *(const uint64_t *)data);
-      break;
-    default:
-      // max lengh of vector
-      if (((width - 1) & width) == 0) {
-        const uint64_t *arr = (const uint64_t *)data;
-
-        fprintf(log_file, "0x");
-        for (int idx = width / 64 - 1; idx >= 0; --idx) {
-          fprintf(log_file, "%016" PRIx64, arr[idx]);
-        }
-      } else {
-        abort();
-      }
-      break;
-  }
-}
-
-static void commit_log_print_value(FILE *log_file, int width, uint64_t val)
-{
-  commit_log_print_value(log_file, width, &val);
-}
-
-static void commit_log_print_insn(processor_t *p, reg_t pc, insn_t insn)
-{
-  FILE *log_file = p->get_log_file();
-
-  auto& reg = p->get_state()->log_reg_write;
-  auto& load = p->get_state()->log_mem_read;
-  auto& store = p->get_state()->log_mem_write;
-  int priv = p->get_state()->last_inst_priv;
-  int xlen = p->get_state()->last_inst_xlen;
-  int flen = p->get_state()->last_inst_flen;
-
-  // print core id on all lines so it is easy to grep
-  fprintf(log_file, "core%4" PRId32 ": ", p->get_id());
-
-  fprintf(log_file, "%1d ", priv);
-  commit_log_print_value(log_file, xlen, pc);
-  fprintf(log_file, " (");
-  commit_log_print_value(log_file, insn.length() * 8, insn.bits());
-  fprintf(log_file, ")");
+  state_t *state = p->get_state();
+  auto& records = state->log_records;
+  auto& reg = state->log_reg_write;
+  auto& load = state->log_mem_read;
+  auto& store = state->log_mem_write;
+
+  records.clear();
+  commit_log_record_t r = {};
+  r.type = COMMIT_LOG_INSN;
+  r.size = state->last_inst_priv;
+  r.xlen = state->last_inst_xlen;
+  r.flen = state->last_inst_flen;
+  r.hart = p->get_id();
+  r.addr = pc;
+  r.data[0] = insn.bits();
+  r.data[1] = insn.length();
+  records.push_back(r);
   bool show_vec = false;
 
   for (auto item : reg) {
     if (item.first == 0)
       continue;
 
-    char prefix = ' ';
-    int size;
-    int rd = item.first >> 4;
-    bool is_vec = false;
-    bool is_vreg = false;
-    switch (item.first & 0xf) {
-    case 0:
-      size = xlen;
-      prefix = 'x';
-      break;
-    case 1:
-      size = flen;
-      prefix = 'f';
-      break;
-    case 2:
-      size = p->VU.VLEN;
-      prefix = 'v';
-      is_vreg = true;
-      break;
-    case 3:
-      is_vec = true;
-      break;
-    case 4:
-      size = xlen;
-      prefix = 'c';
-      break;
-    default:
-      assert("can't been here" && 0);
-      break;
-    }
+    bool is_vreg = (item.first & 0xf) == 2;
+    bool is_vec = (item.first & 0xf) == 3;
 
     if (!show_vec && (is_vreg || is_vec)) {
-        fprintf(log_file, " e%ld %s%ld l%ld",
-                (long)p->VU.vsew,
-                p->VU.vflmul < 1 ? "mf" : "m",
-                p->VU.vflmul < 1 ? (long)(1 / p->VU.vflmul) : (long)p->VU.vflmul,
-                (long)p->VU.vl->read());
-        show_vec = true;
+      r = {};
+      r.type = COMMIT_LOG_VTYPE;
+      r.addr = p->VU.vl->read();
+      r.data[0] = p->VU.vsew;
+      r.data[1] = p->VU.vflmul < 1 ? -(int64_t)(1 / p->VU.vflmul) : (int64_t)p->VU.vflmul;
+      records.push_back(r);
+      show_vec = true;
     }
 
-    if (!is_vec) {
-      if (prefix == 'c')
-        fprintf(log_file, " c%d_%s ", rd, csr_name(rd));
-      else
-        fprintf(log_file, " %c%-2d ", prefix, rd);
-      if (is_vreg)
-        commit_log_print_value(log_file, size, &p->VU.elt<uint8_t>(rd, 0));
-      else
-        commit_log_print_value(log_file, size, item.second.v);
+    if (is_vec)
+      continue;
+
+    r = {};
+    r.type = COMMIT_LOG_REG;
+    r.addr = item.first;
+    if (is_vreg) {
+      int rd = item.first >> 4;
+      r.data[0] = p->VU.VLEN;
+      records.push_back(r);
+      // Vector registers are logged whole, 16 bytes per record
+      const uint8_t *v = &p->VU.elt<uint8_t>(rd, 0);
+      for (reg_t i = 0; i < p->VU.VLEN / 8; i += sizeof(r.data)) {
+        r = {};
+        r.type = COMMIT_LOG_VREG_DATA;
+        memcpy(r.data, v + i, std::min<reg_t>(sizeof(r.data), p->VU.VLEN / 8 - i));
+        records.push_back(r);
+      }
+    } else {
+      r.data[0] = item.second.v[0];
+      r.data[1] = item.second.v[1];
+      records.push_back(r);
     }
   }
 
   for (auto item : load) {
-    fprintf(log_file, " mem ");
-    commit_log_print_value(log_file, xlen, std::get<0>(item));
+    r = {};
+    r.type = COMMIT_LOG_LOAD;
+    r.size = std::get<2>(item);
+    r.addr = std::get<0>(item);
+    records.push_back(r);
   }
 
   for (auto item : store) {
-    fprintf(log_file, " mem ");
-    commit_log_print_value(log_file, xlen, std::get<0>(item));
-    fprintf(log_file, " ");
-    commit_log_print_value(log_file, std::get<2>(item) << 3, std::get<1>(item));
+    r = {};
+    r.type = COMMIT_LOG_STORE;
+    r.size = std::get<2>(item);
+    r.addr = std::get<0>(item);
+    r.data[0] = std::get<1>(item);
+    records.push_back(r);
   }
-  fprintf(log_file, "\n");
+}
+
+// Writes the records of the instruction to the binary commit log, or
+// prints them as text to the log file
+static void commit_log_print_insn(processor_t *p, reg_t pc, insn_t insn)
+{
+  commit_log_capture(p, pc, insn);
+  auto& records = p->get_state()->log_records;
+  if (p->get_commit_log_writer())
+    p->get_commit_log_writer()->write(records.data(), records.size());
+  else
+    commit_log_print(p->get_log_file(), records.data(), records.size());
 }
 
 inline void processor_t::update_histogram(reg_t pc)
@@ -223,8 +191,11 @@ void processor_t::step(size_t n)
   }
 
   while (n > 0) {
+    // With --profile, the hart stops to sample its pc every profile interval
+    size_t budget = unlikely(profile_countdown != 0) ? std::min<size_t>(n, profile_countdown) : n;
     size_t instret = 0;
     reg_t pc = state.pc;
+    const reg_t prv = state.prv;
     mmu_t* _mmu = mmu;
     state.prv_changed = false;
     state.v_changed = false;
@@ -250,7 +221,7 @@ void processor_t::step(size_t n)
       if (unlikely(slow_path()))
       {
         // Main simulation loop, slow path.
-        while (instret < n)
+        while (instret < budget)
         {
           if (unlikely(!state.serialized && state.single_step == state.STEP_STEPPED)) {
             state.single_step = state.STEP_NONE;
@@ -283,23 +254,46 @@ void processor_t::step(size_t n)
           if (debug && !state.serialized)
             disasm(fetch.insn);
           pc = execute_insn_logged(this, pc, fetch);
+          if (unlikely(call_graph != NULL) && !invalid_pc(pc))
+            call_graph->jumped(fetch.insn, state.pc + fetch.insn.length(), pc);
           advance_pc();
         }
       }
-      else while (instret < n)
+      else while (instret < budget)
       {
-        // Main simulation loop, fast path.
-        for (auto ic_entry = _mmu->access_icache(pc); ; ) {
-          auto fetch = ic_entry->data;
-          pc = execute_insn_fast(this, pc, fetch);
-          ic_entry = ic_entry->next;
-          if (unlikely(ic_entry->tag != pc))
-            break;
-          if (unlikely(instret + 1 == n))
+        // Main simulation loop, fast path.  Blocks are clamped to the
+        // remaining budget up front, so the only per-instruction exit check
+        // is whether control left the straight-line run.  Nothing inside a
+        // block reads state.pc (see mmu_t::refill_block_cache), so it is
+        // only written back once the block is left.
+        auto block = _mmu->access_block_cache(pc);
+        size_t i = 0;
+        if (unlikely(jit != NULL)) {
+          if (block->jit_len == 0 && ++block->hits == jit_t::HOT_THRESHOLD)
+            jit->compile(block);
+          // The compiled prefix cannot trap, so it retires as a unit, but
+          // only if the budget leaves room for it.
+          if (block->jit_len != 0 && block->jit_len < budget - instret) {
+            block->jit(const_cast<reg_t*>(&state.XPR[0]));
+            i = block->jit_len;
+            instret += i;
+            pc = block->insns[i - 1].npc;
+            if (i == block->len) {
+              state.pc = pc;
+              continue;
+            }
+          }
+        }
+        const size_t last = std::min(block->len, i + budget - instret) - 1;
+        for (; ; i++) {
+          const block_insn_t& entry = block->insns[i];
+          pc = execute_insn_fast(this, pc, entry.fetch);
+          if (unlikely(pc != entry.npc || i == last))
             break;
           instret++;
-          state.pc = pc;
         }
+        if (unlikely(call_graph != NULL) && !invalid_pc(pc))
+          call_graph->jumped(block->insns[i].fetch.insn, block->insns[i].npc, pc);
 
         advance_pc();
       }
@@ -308,6 +302,13 @@ void processor_t::step(size_t n)
     {
       take_trap(t, pc);
       n = instret;
+      const uint8_t code = t.cause();
+      if (code != t.cause())
+        perf.interrupts[code % 64]++;
+      else
+        perf.exceptions[code % 64]++;
+      if (unlikely(call_graph != NULL))
+        call_graph->trapped(state.pc);
 
       // Trigger action takes priority over single step
       auto match = TM.detect_trap_match(t);
@@ -347,6 +348,21 @@ void processor_t::step(size_t n)
     // Model a hart whose CPI is 1.
     state.mcycle->bump(instret);
 
+    // A step only changes privilege by trapping, which ends it, or by an
+    // xRET, whose successors are charged to the privilege it left
+    perf.instret[prv] += instret;
+
+    if (unlikely(profile_countdown != 0)) {
+      if (instret >= profile_countdown) {
+        pc_samples[state.pc]++;
+        if (call_graph)
+          call_graph->sample(state.pc);
+        profile_countdown = cfg->profile_interval.value();
+      } else {
+        profile_countdown -= instret;
+      }
+    }
+
     n -= instret;
   }
 }
@@ -0,0 +1,80 @@
+// See LICENSE for license details.
+
+#include "hart_threads.h"
+
+hart_threads_t::hart_threads_t(size_t nthreads)
+  : first_worker(0), last_worker(0), generation(0), pending(0), exiting(false)
+{
+  for (size_t t = 0; t < nthreads; t++)
+    threads.emplace_back(&hart_threads_t::worker, this, t);
+}
+
+hart_threads_t::~hart_threads_t()
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    exiting = true;
+  }
+  work_ready.notify_all();
+  for (auto& thread : threads)
+    thread.join();
+}
+
+void hart_threads_t::worker(size_t t)
+{
+  uint64_t seen = 0;
+  while (true) {
+    std::function<void(size_t)> job;
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      work_ready.wait(guard, [&] {
+        return exiting || (generation != seen && t >= first_worker && t < last_worker);
+      });
+      if (exiting)
+        return;
+      seen = generation;
+      job = current_job;
+    }
+
+    std::exception_ptr e;
+    try {
+      job(t);
+    } catch (...) {
+      e = std::current_exception();
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    if (e && !error)
+      error = e;
+    if (--pending == 0)
+      work_done.notify_one();
+  }
+}
+
+void hart_threads_t::run(size_t first, size_t last, std::function<void(size_t)> job)
+{
+  std::unique_lock<std::mutex> guard(lock);
+  current_job = job;
+  first_worker = first;
+  last_worker = last;
+  pending = last - first;
+  generation++;
+  work_ready.notify_all();
+  work_done.wait(guard, [&] { return pending == 0; });
+
+  if (error) {
+    std::exception_ptr e = error;
+    error = nullptr;
+    std::rethrow_exception(e);
+  }
+}
+
+void hart_threads_t::run_all(std::function<void(size_t)> job)
+{
+  run(0, threads.size(), job);
+}
+
+void hart_threads_t::run_on(size_t t, std::function<void(size_t)> job)
+{
+  run(t, t + 1, job);
+}
@@ -0,0 +1,45 @@
+// See LICENSE for license details.
+
+#ifndef _RISCV_HART_THREADS_H
+#define _RISCV_HART_THREADS_H
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of host threads that sim_t hands hart quanta to.  Work is
+// always issued by the simulation thread, which blocks until it completes,
+// so devices, HTIF and the debug module never run concurrently with harts.
+class hart_threads_t
+{
+public:
+  hart_threads_t(size_t nthreads);
+  ~hart_threads_t();
+
+  size_t size() const { return threads.size(); }
+
+  // Run job(t) on every thread t and wait for all of them to finish.
+  void run_all(std::function<void(size_t)> job);
+  // Run job on thread t alone and wait for it to finish.
+  void run_on(size_t t, std::function<void(size_t)> job);
+
+private:
+  void worker(size_t t);
+  void run(size_t first, size_t last, std::function<void(size_t)> job);
+
+  std::vector<std::thread> threads;
+  std::mutex lock;
+  std::condition_variable work_ready;
+  std::condition_variable work_done;
+  std::function<void(size_t)> current_job;
+  size_t first_worker, last_worker;  // threads [first, last) run current_job
+  uint64_t generation;
+  size_t pending;
+  bool exiting;
+  std::exception_ptr error;
+};
+
+#endif
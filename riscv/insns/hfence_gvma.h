@@ -1,4 +1,5 @@
 require_extension('H');
 require_novirt();
 require_privilege(get_field(STATE.mstatus->read(), MSTATUS_TVM) ? PRV_M : PRV_S);
-MMU.flush_tlb();
+MMU.flush_tlb_gvma(insn.rs1() ? std::optional<reg_t>(RS1 << 2) : std::nullopt,
+                   insn.rs2() ? std::optional<reg_t>(RS2) : std::nullopt);
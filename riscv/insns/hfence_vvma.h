@@ -1,4 +1,6 @@
 require_extension('H');
 require_novirt();
 require_privilege(PRV_S);
-MMU.flush_tlb();
+MMU.flush_tlb_vma(true,
+                  insn.rs1() ? std::optional<reg_t>(RS1) : std::nullopt,
+                  insn.rs2() ? std::optional<reg_t>(RS2) : std::nullopt);
@@ -0,0 +1,84 @@
+// See LICENSE for license details.
+
+#include "iopmp_index.h"
+#include "processor.h"
+#include "mmu.h"
+#include <algorithm>
+
+void iopmp_index_t::rebuild(processor_t* proc)
+{
+  state_t* state = proc->get_state();
+  tables.assign(proc->sid_num, {});
+
+  for (reg_t sid = 0; sid < proc->sid_num; sid++) {
+    std::vector<reg_t> entry_idxs;
+    for (reg_t mdcfg_idx : state->srcmd[sid]->associated_mds())
+      state->mdcfg[mdcfg_idx]->entries_belonging_to_md(&entry_idxs);
+
+    for (access_type type : {LOAD, STORE, FETCH}) {
+      std::vector<std::pair<reg_t, reg_t>> ranges;
+      for (reg_t entry_idx : entry_idxs) {
+        const entry_addr_csr_t_p& entry_addr = state->entry_addr[entry_idx];
+        reg_t base, top;
+        if (entry_addr->range(&base, &top) && entry_addr->access_ok(type))
+          ranges.push_back({base, top});
+      }
+      std::sort(ranges.begin(), ranges.end());
+
+      auto& table = tables[sid][type];
+      reg_t max_top = 0;
+      for (auto& [base, top] : ranges) {
+        max_top = std::max(max_top, top);
+        table.push_back({base, max_top});
+      }
+    }
+  }
+
+  for (auto& v : verdicts)
+    v.page = -1;
+  stale = false;
+}
+
+// Whether one range holds all of [addr, addr + len)
+bool iopmp_index_t::lookup(reg_t sid, reg_t addr, reg_t len, access_type type) const
+{
+  // Among the ranges starting at or below addr, one holds the last byte of
+  // the transaction iff the highest top among them lies above it
+  const auto& table = tables[sid][type];
+  auto it = std::upper_bound(table.begin(), table.end(), addr,
+                             [](reg_t a, const range_t& r) { return a < r.base; });
+  return it != table.begin() && addr + len - 1 < std::prev(it)->max_top;
+}
+
+// Whether any range shares a byte with [addr, addr + len)
+bool iopmp_index_t::any_overlap(reg_t sid, reg_t addr, reg_t len, access_type type) const
+{
+  const auto& table = tables[sid][type];
+  auto it = std::upper_bound(table.begin(), table.end(), addr + len - 1,
+                             [](reg_t a, const range_t& r) { return a < r.base; });
+  return it != table.begin() && addr < std::prev(it)->max_top;
+}
+
+bool iopmp_index_t::access_ok(processor_t* proc, reg_t sid, reg_t addr, reg_t len, access_type type)
+{
+  // sid_num may also have been changed directly, as the IOPMP tests do
+  if (stale || tables.size() != proc->sid_num)
+    rebuild(proc);
+
+  const reg_t page = addr >> PGSHIFT;
+  if (len == 0 || (addr + len - 1) >> PGSHIFT != page)
+    return lookup(sid, addr, len, type);
+
+  page_verdict_t& v = verdicts[(page ^ (sid << 2) ^ type) % verdict_cache_size];
+  if (v.page == page && v.sid == sid && v.type == type)
+    return v.ok;
+
+  const reg_t page_addr = page << PGSHIFT;
+  if (lookup(sid, page_addr, PGSIZE, type))
+    v = {page, sid, type, true};
+  else if (!any_overlap(sid, page_addr, PGSIZE, type))
+    v = {page, sid, type, false};
+  else
+    return lookup(sid, addr, len, type);
+  return v.ok;
+}
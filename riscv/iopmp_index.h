@@ -0,0 +1,60 @@
+// See LICENSE for license details.
+#ifndef _RISCV_IOPMP_INDEX_H
+#define _RISCV_IOPMP_INDEX_H
+
+#include "decode.h"
+#include "memtracer.h"
+#include <array>
+#include <vector>
+
+class processor_t;
+
+// Answers IOPMP checks from a per-SID table of the address ranges that each
+// access type is granted, instead of walking the SRCMD, MDCFG and entry CSRs
+// on every transaction.  The table is rebuilt on the first check after any
+// of those CSRs is written.
+class iopmp_index_t {
+ public:
+  void invalidate() noexcept {
+    stale = true;
+  }
+
+  // Whether some entry of a memory domain associated with sid matches all
+  // bytes of the transaction and grants the access
+  // Specified in section 2.6: Priority and Matching Logic, of the RISC-V IOPMP specification (Version 1.0.0-draft5)
+  bool access_ok(processor_t* proc, reg_t sid, reg_t addr, reg_t len, access_type type);
+
+ private:
+  void rebuild(processor_t* proc);
+  bool lookup(reg_t sid, reg_t addr, reg_t len, access_type type) const;
+  bool any_overlap(reg_t sid, reg_t addr, reg_t len, access_type type) const;
+
+  // A range [base, top) granted by an entry.  The ranges of each table are
+  // sorted by base, and max_top is the highest top among a range and those
+  // before it, so one binary search finds whether any range holds the
+  // transaction.
+  struct range_t {
+    reg_t base;
+    reg_t max_top;
+  };
+
+  // tables[sid][type]
+  std::vector<std::array<std::vector<range_t>, 3>> tables;
+
+  // Verdicts for whole pages that one range holds, or that no range
+  // touches, so that every transaction within them gets the same answer.
+  // Like the TLB's use of pmp_homogeneous, pages that straddle the edge of
+  // a range are never cached.
+  struct page_verdict_t {
+    reg_t page;
+    reg_t sid;
+    access_type type;
+    bool ok;
+  };
+  static const size_t verdict_cache_size = 64;
+  std::array<page_verdict_t, verdict_cache_size> verdicts;
+
+  bool stale = true;
+};
+
+#endif
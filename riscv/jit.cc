@@ -0,0 +1,267 @@
+// See LICENSE for license details.
+
+#include "jit.h"
+#include "processor.h"
+#include "mmu.h"
+#if RISCV_JIT_SUPPORTED
+#include <sys/mman.h>
+#endif
+
+// The interpreter routines for the instructions the JIT understands.  Matching
+// on the decoded function, rather than on the instruction bits, means the JIT
+// only ever sees instructions that decode_insn() resolved to exactly these
+// semantics for a 64-bit hart.
+#define DECLARE_JIT_INSN(name) reg_t fast_rv64i_##name(processor_t*, insn_t, reg_t);
+DECLARE_JIT_INSN(add) DECLARE_JIT_INSN(sub) DECLARE_JIT_INSN(and)
+DECLARE_JIT_INSN(or) DECLARE_JIT_INSN(xor) DECLARE_JIT_INSN(sll)
+DECLARE_JIT_INSN(srl) DECLARE_JIT_INSN(sra) DECLARE_JIT_INSN(slt)
+DECLARE_JIT_INSN(sltu) DECLARE_JIT_INSN(addi) DECLARE_JIT_INSN(andi)
+DECLARE_JIT_INSN(ori) DECLARE_JIT_INSN(xori) DECLARE_JIT_INSN(slli)
+DECLARE_JIT_INSN(srli) DECLARE_JIT_INSN(srai) DECLARE_JIT_INSN(slti)
+DECLARE_JIT_INSN(sltiu) DECLARE_JIT_INSN(lui) DECLARE_JIT_INSN(auipc)
+DECLARE_JIT_INSN(addw) DECLARE_JIT_INSN(subw) DECLARE_JIT_INSN(sllw)
+DECLARE_JIT_INSN(srlw) DECLARE_JIT_INSN(sraw) DECLARE_JIT_INSN(addiw)
+DECLARE_JIT_INSN(slliw) DECLARE_JIT_INSN(srliw) DECLARE_JIT_INSN(sraiw)
+DECLARE_JIT_INSN(mul) DECLARE_JIT_INSN(mulh) DECLARE_JIT_INSN(mulhu)
+DECLARE_JIT_INSN(mulw)
+DECLARE_JIT_INSN(c_addi) DECLARE_JIT_INSN(c_li) DECLARE_JIT_INSN(c_lui)
+DECLARE_JIT_INSN(c_jal) DECLARE_JIT_INSN(c_mv) DECLARE_JIT_INSN(c_add)
+DECLARE_JIT_INSN(c_slli) DECLARE_JIT_INSN(c_srli) DECLARE_JIT_INSN(c_srai)
+DECLARE_JIT_INSN(c_andi) DECLARE_JIT_INSN(c_sub) DECLARE_JIT_INSN(c_xor)
+DECLARE_JIT_INSN(c_or) DECLARE_JIT_INSN(c_and) DECLARE_JIT_INSN(c_subw)
+DECLARE_JIT_INSN(c_addw)
+#undef DECLARE_JIT_INSN
+
+jit_t::jit_t(processor_t* proc)
+  : proc(proc), code(nullptr), code_used(0)
+{
+#if RISCV_JIT_SUPPORTED
+  void* p = mmap(NULL, CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  // If the host refuses executable mappings, just keep interpreting.
+  if (p != MAP_FAILED)
+    code = (uint8_t*)p;
+#endif
+}
+
+jit_t::~jit_t()
+{
+#if RISCV_JIT_SUPPORTED
+  if (code)
+    munmap(code, CODE_SIZE);
+#endif
+}
+
+bool jit_t::translate(const insn_fetch_t& fetch, reg_t pc, uop_t* uop)
+{
+  const insn_func_t f = fetch.func;
+  insn_t insn = fetch.insn;
+
+  auto rr = [uop](op_t op, unsigned rd, unsigned rs1, unsigned rs2) {
+    *uop = {op, rd, rs1, rs2, false, 0};
+    return true;
+  };
+  auto ri = [uop](op_t op, unsigned rd, unsigned rs1, reg_t imm) {
+    *uop = {op, rd, rs1, 0, true, imm};
+    return true;
+  };
+
+  if (f == fast_rv64i_add) return rr(OP_ADD, insn.rd(), insn.rs1(), insn.rs2());
+  if (f == fast_rv64i_sub) return rr(OP_SUB, insn.rd(), insn.rs1(), insn.rs2());
+  if (f == fast_rv64i_and) return rr(OP_AND, insn.rd(), insn.rs1(), insn.rs2());
+  if (f == fast_rv64i_or) return rr(OP_OR, insn.rd(), insn.rs1(), insn.rs2());
+  if (f == fast_rv64i_xor) return rr(OP_XOR, insn.rd(), insn.rs1(), insn.rs2());
+  if (f == fast_rv64i_sll) return rr(OP_SLL, insn.rd(), insn.rs1(), insn.rs2());
+  if (f == fast_rv64i_srl) return rr(OP_SRL, insn.rd(), insn.rs1(), insn.rs2());
+  if (f == fast_rv64i_sra) return rr(OP_SRA, insn.rd(), insn.rs1(), insn.rs2());
+  if (f == fast_rv64i_slt) return rr(OP_SLT, insn.rd(), insn.rs1(), insn.rs2());
+  if (f == fast_rv64i_sltu) return rr(OP_SLTU, insn.rd(), insn.rs1(), insn.rs2());
+  if (f == fast_rv64i_addw) return rr(OP_ADDW, insn.rd(), insn.rs1(), insn.rs2());
+  if (f == fast_rv64i_subw) return rr(OP_SUBW, insn.rd(), insn.rs1(), insn.rs2());
+  if (f == fast_rv64i_sllw) return rr(OP_SLLW, insn.rd(), insn.rs1(), insn.rs2());
+  if (f == fast_rv64i_srlw) return rr(OP_SRLW, insn.rd(), insn.rs1(), insn.rs2());
+  if (f == fast_rv64i_sraw) return rr(OP_SRAW, insn.rd(), insn.rs1(), insn.rs2());
+
+  if (f == fast_rv64i_addi) return ri(OP_ADD, insn.rd(), insn.rs1(), insn.i_imm());
+  if (f == fast_rv64i_andi) return ri(OP_AND, insn.rd(), insn.rs1(), insn.i_imm());
+  if (f == fast_rv64i_ori) return ri(OP_OR, insn.rd(), insn.rs1(), insn.i_imm());
+  if (f == fast_rv64i_xori) return ri(OP_XOR, insn.rd(), insn.rs1(), insn.i_imm());
+  if (f == fast_rv64i_slti) return ri(OP_SLT, insn.rd(), insn.rs1(), insn.i_imm());
+  if (f == fast_rv64i_sltiu) return ri(OP_SLTU, insn.rd(), insn.rs1(), insn.i_imm());
+  if (f == fast_rv64i_slli) return ri(OP_SLL, insn.rd(), insn.rs1(), insn.shamt());
+  if (f == fast_rv64i_srli) return ri(OP_SRL, insn.rd(), insn.rs1(), insn.shamt());
+  if (f == fast_rv64i_srai) return ri(OP_SRA, insn.rd(), insn.rs1(), insn.shamt());
+  if (f == fast_rv64i_addiw) return ri(OP_ADDW, insn.rd(), insn.rs1(), insn.i_imm());
+  if (f == fast_rv64i_slliw) return ri(OP_SLLW, insn.rd(), insn.rs1(), insn.shamt());
+  if (f == fast_rv64i_srliw) return ri(OP_SRLW, insn.rd(), insn.rs1(), insn.shamt());
+  if (f == fast_rv64i_sraiw) return ri(OP_SRAW, insn.rd(), insn.rs1(), insn.shamt());
+  if (f == fast_rv64i_lui) return ri(OP_ADD, insn.rd(), 0, insn.u_imm());
+  if (f == fast_rv64i_auipc) return ri(OP_ADD, insn.rd(), 0, pc + insn.u_imm());
+
+  // M and C can be switched off through misa; the compiled code skips the
+  // check the interpreter would make, so misa writes flush the block cache.
+  if (proc->extension_enabled('M') || proc->extension_enabled(EXT_ZMMUL)) {
+    if (f == fast_rv64i_mul) return rr(OP_MUL, insn.rd(), insn.rs1(), insn.rs2());
+    if (f == fast_rv64i_mulh) return rr(OP_MULH, insn.rd(), insn.rs1(), insn.rs2());
+    if (f == fast_rv64i_mulhu) return rr(OP_MULHU, insn.rd(), insn.rs1(), insn.rs2());
+    if (f == fast_rv64i_mulw) return rr(OP_MULW, insn.rd(), insn.rs1(), insn.rs2());
+  }
+
+  if (!proc->extension_enabled(EXT_ZCA))
+    return false;
+
+  const unsigned rd = insn.rvc_rd(), rs1s = insn.rvc_rs1s();
+  if (f == fast_rv64i_c_addi) return ri(OP_ADD, rd, rd, insn.rvc_imm());
+  if (f == fast_rv64i_c_li) return ri(OP_ADD, rd, 0, insn.rvc_imm());
+  if (f == fast_rv64i_c_lui) {
+    if (rd == 2 && insn.rvc_addi16sp_imm() != 0)
+      return ri(OP_ADD, X_SP, X_SP, insn.rvc_addi16sp_imm());
+    if (rd != 2 && insn.rvc_imm() != 0)
+      return ri(OP_ADD, rd, 0, insn.rvc_imm() << 12);
+    return false;
+  }
+  if (f == fast_rv64i_c_jal && rd != 0) return ri(OP_ADDW, rd, rd, insn.rvc_imm()); // c.addiw
+  if (f == fast_rv64i_c_mv && insn.rvc_rs2() != 0) return rr(OP_ADD, rd, 0, insn.rvc_rs2());
+  if (f == fast_rv64i_c_add && insn.rvc_rs2() != 0) return rr(OP_ADD, rd, rd, insn.rvc_rs2());
+  if (f == fast_rv64i_c_slli) return ri(OP_SLL, rd, rd, insn.rvc_zimm());
+  if (f == fast_rv64i_c_srli) return ri(OP_SRL, rs1s, rs1s, insn.rvc_zimm());
+  if (f == fast_rv64i_c_srai) return ri(OP_SRA, rs1s, rs1s, insn.rvc_zimm());
+  if (f == fast_rv64i_c_andi) return ri(OP_AND, rs1s, rs1s, insn.rvc_imm());
+  if (f == fast_rv64i_c_sub) return rr(OP_SUB, rs1s, rs1s, insn.rvc_rs2s());
+  if (f == fast_rv64i_c_xor) return rr(OP_XOR, rs1s, rs1s, insn.rvc_rs2s());
+  if (f == fast_rv64i_c_or) return rr(OP_OR, rs1s, rs1s, insn.rvc_rs2s());
+  if (f == fast_rv64i_c_and) return rr(OP_AND, rs1s, rs1s, insn.rvc_rs2s());
+  if (f == fast_rv64i_c_subw) return rr(OP_SUBW, rs1s, rs1s, insn.rvc_rs2s());
+  if (f == fast_rv64i_c_addw) return rr(OP_ADDW, rs1s, rs1s, insn.rvc_rs2s());
+
+  return false;
+}
+
+void jit_t::emit_bytes(std::initializer_list<uint8_t> bytes)
+{
+  for (auto b : bytes)
+    code[code_used++] = b;
+}
+
+void jit_t::emit_u32(uint32_t x)
+{
+  for (int i = 0; i < 4; i++)
+    code[code_used++] = x >> (8 * i);
+}
+
+void jit_t::emit_u64(uint64_t x)
+{
+  emit_u32(x);
+  emit_u32(x >> 32);
+}
+
+// The generated code is called as void(reg_t* xpr): the register file is
+// addressed off %rdi, and %rax, %rcx and %rdx are used as scratch.
+void jit_t::emit(const uop_t& uop)
+{
+  // %rax = rs1
+  if (uop.rs1 == 0)
+    emit_bytes({0x31, 0xc0});                     // xor %eax, %eax
+  else {
+    emit_bytes({0x48, 0x8b, 0x87});               // mov disp32(%rdi), %rax
+    emit_u32(uop.rs1 * sizeof(reg_t));
+  }
+
+  // %rcx = rs2 or imm
+  if (uop.use_imm) {
+    if ((reg_t)(int32_t)uop.imm == uop.imm) {
+      emit_bytes({0x48, 0xc7, 0xc1});             // mov $imm32, %rcx
+      emit_u32(uop.imm);
+    } else {
+      emit_bytes({0x48, 0xb9});                   // movabs $imm64, %rcx
+      emit_u64(uop.imm);
+    }
+  } else if (uop.rs2 == 0) {
+    emit_bytes({0x31, 0xc9});                     // xor %ecx, %ecx
+  } else {
+    emit_bytes({0x48, 0x8b, 0x8f});               // mov disp32(%rdi), %rcx
+    emit_u32(uop.rs2 * sizeof(reg_t));
+  }
+
+  // x86 masks shift counts to 6 bits (5 for 32-bit operands), exactly as
+  // RISC-V does, so shifts need no explicit masking.
+  switch (uop.op) {
+    case OP_ADD:   emit_bytes({0x48, 0x01, 0xc8}); break;  // add %rcx, %rax
+    case OP_SUB:   emit_bytes({0x48, 0x29, 0xc8}); break;  // sub %rcx, %rax
+    case OP_AND:   emit_bytes({0x48, 0x21, 0xc8}); break;  // and %rcx, %rax
+    case OP_OR:    emit_bytes({0x48, 0x09, 0xc8}); break;  // or %rcx, %rax
+    case OP_XOR:   emit_bytes({0x48, 0x31, 0xc8}); break;  // xor %rcx, %rax
+    case OP_SLL:   emit_bytes({0x48, 0xd3, 0xe0}); break;  // shl %cl, %rax
+    case OP_SRL:   emit_bytes({0x48, 0xd3, 0xe8}); break;  // shr %cl, %rax
+    case OP_SRA:   emit_bytes({0x48, 0xd3, 0xf8}); break;  // sar %cl, %rax
+    case OP_SLT:
+    case OP_SLTU:
+      emit_bytes({0x48, 0x39, 0xc8});                      // cmp %rcx, %rax
+      if (uop.op == OP_SLT)
+        emit_bytes({0x0f, 0x9c, 0xc0});                    // setl %al
+      else
+        emit_bytes({0x0f, 0x92, 0xc0});                    // setb %al
+      emit_bytes({0x0f, 0xb6, 0xc0});                      // movzbl %al, %eax
+      break;
+    case OP_ADDW:  emit_bytes({0x01, 0xc8}); break;        // add %ecx, %eax
+    case OP_SUBW:  emit_bytes({0x29, 0xc8}); break;        // sub %ecx, %eax
+    case OP_SLLW:  emit_bytes({0xd3, 0xe0}); break;        // shl %cl, %eax
+    case OP_SRLW:  emit_bytes({0xd3, 0xe8}); break;        // shr %cl, %eax
+    case OP_SRAW:  emit_bytes({0xd3, 0xf8}); break;        // sar %cl, %eax
+    case OP_MUL:   emit_bytes({0x48, 0x0f, 0xaf, 0xc1}); break;  // imul %rcx, %rax
+    case OP_MULW:  emit_bytes({0x0f, 0xaf, 0xc1}); break;        // imul %ecx, %eax
+    case OP_MULH:
+    case OP_MULHU:
+      if (uop.op == OP_MULH)
+        emit_bytes({0x48, 0xf7, 0xe9});                    // imul %rcx
+      else
+        emit_bytes({0x48, 0xf7, 0xe1});                    // mul %rcx
+      emit_bytes({0x48, 0x89, 0xd0});                      // mov %rdx, %rax
+      break;
+  }
+
+  switch (uop.op) {
+    case OP_ADDW: case OP_SUBW: case OP_SLLW: case OP_SRLW: case OP_SRAW: case OP_MULW:
+      emit_bytes({0x48, 0x63, 0xc0});                      // movslq %eax, %rax
+      break;
+    default:
+      break;
+  }
+
+  // rd = %rax
+  if (uop.rd != 0) {
+    emit_bytes({0x48, 0x89, 0x87});               // mov %rax, disp32(%rdi)
+    emit_u32(uop.rd * sizeof(reg_t));
+  }
+}
+
+void jit_t::compile(block_cache_entry_t* block)
+{
+  if (!code || block->tag == (reg_t)-1)
+    return;
+
+  uop_t uops[mmu_t::MAX_BLOCK_INSNS];
+  size_t n = 0;
+  for (reg_t pc = block->tag; n < block->len; pc = block->insns[n++].npc) {
+    if (!translate(block->insns[n].fetch, pc, &uops[n]))
+      break;
+  }
+  if (n == 0)
+    return;
+
+  // No instruction needs more than 40 bytes.  When the buffer fills up, start
+  // over; flushing the block cache drops every pointer into the old code.
+  if (code_used + n * 40 + 1 > CODE_SIZE) {
+    code_used = 0;
+    proc->get_mmu()->flush_icache();
+    return;
+  }
+
+  uint8_t* start = code + code_used;
+  for (size_t i = 0; i < n; i++)
+    emit(uops[i]);
+  emit_bytes({0xc3});                             // ret
+
+  block->jit = (block_jit_func_t)start;
+  block->jit_len = n;
+}
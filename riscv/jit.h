@@ -0,0 +1,66 @@
+// See LICENSE for license details.
+
+#ifndef _RISCV_JIT_H
+#define _RISCV_JIT_H
+
+#include "decode.h"
+#include <cstdint>
+#include <initializer_list>
+
+class processor_t;
+struct block_cache_entry_t;
+struct insn_fetch_t;
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#define RISCV_JIT_SUPPORTED 1
+#else
+#define RISCV_JIT_SUPPORTED 0
+#endif
+
+// Translates hot instruction blocks into host code.  Only the leading run of
+// register-to-register integer instructions (RV64I/M ALU operations and
+// their compressed forms) is compiled; the compiled code reads and writes the
+// integer register file directly and can neither trap nor touch memory.  The
+// rest of the block is still dispatched through its insn_func_t.
+class jit_t
+{
+public:
+  jit_t(processor_t* proc);
+  ~jit_t();
+
+  // Number of times a block is entered before it is compiled.
+  static const unsigned HOT_THRESHOLD = 64;
+
+  static bool host_supported() { return RISCV_JIT_SUPPORTED; }
+
+  // Compile the prefix of block, if any, and record it in the block.
+  void compile(block_cache_entry_t* block);
+
+private:
+  enum op_t {
+    OP_ADD, OP_SUB, OP_AND, OP_OR, OP_XOR, OP_SLL, OP_SRL, OP_SRA,
+    OP_SLT, OP_SLTU, OP_ADDW, OP_SUBW, OP_SLLW, OP_SRLW, OP_SRAW,
+    OP_MUL, OP_MULH, OP_MULHU, OP_MULW,
+  };
+
+  // rd = rs1 <op> (use_imm ? imm : rs2)
+  struct uop_t {
+    op_t op;
+    unsigned rd, rs1, rs2;
+    bool use_imm;
+    reg_t imm;
+  };
+
+  bool translate(const insn_fetch_t& fetch, reg_t pc, uop_t* uop);
+  void emit(const uop_t& uop);
+  void emit_bytes(std::initializer_list<uint8_t> bytes);
+  void emit_u32(uint32_t x);
+  void emit_u64(uint64_t x);
+
+  processor_t* const proc;
+  uint8_t* code;
+  size_t code_used;
+  static const size_t CODE_SIZE = 16 << 20;
+};
+
+#endif
@@ -5,6 +5,9 @@
 #include "arith.h"
 #include "simif.h"
 #include "processor.h"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
 
 mmu_t::mmu_t(simif_t* sim, endianness_t endianness, processor_t* proc, processor_t* iopmp_proc)
  : sim(sim), proc(proc), iopmp_proc(iopmp_proc),
@@ -19,6 +22,21 @@ mmu_t::mmu_t(simif_t* sim, endianness_t endianness, processor_t* proc, processor
 #ifndef RISCV_ENABLE_DUAL_ENDIAN
   assert(endianness == endianness_little);
 #endif
+  tlb_entries = proc ? proc->get_cfg().tlb_entries : 256;
+  tlb_ways = proc ? proc->get_cfg().tlb_ways : 1;
+  tlb_policy = proc ? proc->get_cfg().tlb_policy : tlb_policy_lru;
+  assert(tlb_ways > 0 && (tlb_ways & (tlb_ways - 1)) == 0);
+  assert(tlb_entries >= tlb_ways && (tlb_entries & (tlb_entries - 1)) == 0);
+  tlb_ways_shift = ctz(tlb_ways);
+  tlb_set_mask = (tlb_entries >> tlb_ways_shift) - 1;
+  tlb_random_state = 1;
+  tlb_data.reset(new tlb_entry_t[tlb_entries]());
+  tlb_insn_tag.reset(new reg_t[tlb_entries]);
+  tlb_load_tag.reset(new reg_t[tlb_entries]);
+  tlb_store_tag.reset(new reg_t[tlb_entries]);
+  memset(tlb_hits, 0, sizeof(tlb_hits));
+  memset(tlb_misses, 0, sizeof(tlb_misses));
+
   flush_tlb();
   yield_load_reservation();
 }
@@ -27,21 +45,281 @@ mmu_t::~mmu_t()
 {
 }
 
+void mmu_t::print_tlb_stats(const char* name)
+{
+  static const char* const types[] = {"DTLB Load ", "DTLB Store", "ITLB      "};
+
+  std::cout << std::setprecision(3) << std::fixed;
+  for (access_type type : {FETCH, LOAD, STORE}) {
+    reg_t accesses = tlb_hits[type] + tlb_misses[type];
+    float mr = accesses ? 100.0f * tlb_misses[type] / accesses : 0.0f;
+    std::cout << name << " " << types[type] << " Accesses:  " << accesses << std::endl;
+    std::cout << name << " " << types[type] << " Misses:    " << tlb_misses[type] << std::endl;
+    std::cout << name << " " << types[type] << " Miss Rate: " << mr << '%' << std::endl;
+  }
+}
+
 void mmu_t::flush_icache()
 {
   for (size_t i = 0; i < ICACHE_ENTRIES; i++)
     icache[i].tag = -1;
+  for (size_t i = 0; i < BLOCK_CACHE_ENTRIES; i++)
+    block_cache[i].tag = -1;
+}
+
+// Instructions that may read state.pc, flush the instruction cache or change
+// translation (SYSTEM, FENCE.I and C.EBREAK) always form a block of their
+// own.  That way processor_t::step() only has to write state.pc back at
+// block boundaries.
+static bool runs_alone(insn_t insn)
+{
+  insn_bits_t bits = insn.bits();
+  if ((bits & 3) != 3)
+    return bits == 0x9002; // c.ebreak
+
+  switch (bits & 0x7f) {
+    case 0x73: // SYSTEM
+      return true;
+    case 0x0f: // MISC-MEM
+      return ((bits >> 12) & 7) == 1; // fence.i
+    default:
+      return false;
+  }
+}
+
+// Instructions after which a block must end: unconditional jumps, because
+// their fall-through is never taken, and those that run alone.
+static bool ends_block(insn_t insn)
+{
+  insn_bits_t bits = insn.bits();
+  if ((bits & 3) != 3) {
+    const unsigned quadrant = bits & 3, funct3 = (bits >> 13) & 7;
+    return (quadrant == 1 && funct3 == 5) ||                      // c.j
+           (quadrant == 2 && funct3 == 4 && ((bits >> 2) & 0x1f) == 0); // c.jr, c.jalr, c.ebreak
+  }
+
+  switch (bits & 0x7f) {
+    case 0x6f: // jal
+    case 0x67: // jalr
+      return true;
+    default:
+      return runs_alone(insn);
+  }
+}
+
+block_cache_entry_t* mmu_t::refill_block_cache(reg_t addr, block_cache_entry_t* block)
+{
+  // The first instruction is fetched like any other, so it can fault.
+  icache_entry_t* entry = access_icache(addr);
+  insn_fetch_t fetch = entry->data;
+  reg_t pc = addr + fetch.insn.length();
+  block->insns[0] = {fetch, pc};
+  block->len = 1;
+  block->hits = 0;
+  block->jit_len = 0;
+  block->jit = nullptr;
+
+  // Successors are only added while they are known to lie on the same,
+  // already-translated page, so decoding them ahead of time cannot fault or
+  // skip a trigger check.  Traced fetches are never cached.
+  reg_t vpn = addr >> PGSHIFT;
+  bool cacheable = entry->tag == addr;
+  bool extend = cacheable &&
+                !check_triggers_fetch && !check_triggers_load && !check_triggers_store &&
+                tlb_insn_tag[tlb_index(vpn)] == (vpn | tlb_context);
+  while (extend && block->len < MAX_BLOCK_INSNS && !ends_block(fetch.insn)) {
+    if ((pc >> PGSHIFT) != vpn)
+      break;
+    int length = insn_length(from_le(*(const uint16_t*)(tlb_data[tlb_index(vpn)].host_offset + pc)));
+    if (((pc + length - 1) >> PGSHIFT) != vpn)
+      break;
+
+    entry = access_icache(pc);
+    if (entry->tag != pc || runs_alone(entry->data.insn))
+      break;
+    fetch = entry->data;
+    block->insns[block->len++] = {fetch, pc + length};
+    pc += length;
+  }
+
+  block->tag = cacheable ? addr : -1;
+  block->context = tlb_context;
+  return block;
 }
 
 void mmu_t::flush_tlb()
 {
-  memset(tlb_insn_tag, -1, sizeof(tlb_insn_tag));
-  memset(tlb_load_tag, -1, sizeof(tlb_load_tag));
-  memset(tlb_store_tag, -1, sizeof(tlb_store_tag));
+  memset(tlb_insn_tag.get(), -1, tlb_entries * sizeof(reg_t));
+  memset(tlb_load_tag.get(), -1, tlb_entries * sizeof(reg_t));
+  memset(tlb_store_tag.get(), -1, tlb_entries * sizeof(reg_t));
+  tlb_contexts_used = 0;
+  tlb_next_victim_context = 0;
+  tlb_context = TLB_CONTEXT_STALE;
+  tlb_has_superpages = false;
+  for (size_t i = 0; i < PWC_ENTRIES; i++)
+    pwc[i].atp = 0;
 
   flush_icache();
 }
 
+void mmu_t::lookup_tlb_context()
+{
+  tlb_context_t context = {};
+  if (proc) {
+    reg_t mstatus = proc->state.mstatus->read();
+    reg_t status_mask = MSTATUS_MXR | MSTATUS_SUM | MSTATUS_MPRV;
+    if (mstatus & MSTATUS_MPRV)
+      status_mask |= MSTATUS_MPP | MSTATUS_MPV;
+
+    context.prv = proc->state.prv;
+    context.v = proc->state.v;
+    if (context.prv == PRV_M && !(mstatus & MSTATUS_MPRV))
+      status_mask = 0;  // untranslated, whatever satp holds
+    else
+      context.satp = proc->state.satp->readvirt(context.v);
+    context.status = mstatus & status_mask;
+    if (context.v) {
+      context.hgatp = proc->state.hgatp->read();
+      // vsstatus has the same layout as sstatus, whose bits don't overlap
+      // MPRV, MPP or MPV
+      context.status |= (proc->state.sstatus->readvirt(true) & (MSTATUS_MXR | MSTATUS_SUM)) << 32;
+    }
+  }
+
+  size_t i;
+  for (i = 0; i < tlb_contexts_used; i++)
+    if (tlb_contexts[i] == context)
+      break;
+
+  if (i == tlb_contexts_used) {
+    if (tlb_contexts_used < TLB_CONTEXTS) {
+      tlb_contexts_used++;
+    } else {
+      i = tlb_next_victim_context;
+      tlb_next_victim_context = (i + 1) % TLB_CONTEXTS;
+      flush_tlb_context(i, std::nullopt);
+    }
+    tlb_contexts[i] = context;
+  }
+
+  tlb_context = reg_t(i) << TLB_CONTEXT_SHIFT;
+}
+
+void mmu_t::flush_tlb_context(size_t context, std::optional<reg_t> vpn)
+{
+  reg_t context_tag = reg_t(context) << TLB_CONTEXT_SHIFT;
+
+  if (vpn) {
+    size_t idx = tlb_index(*vpn);
+    reg_t tag = *vpn | context_tag;
+    for (size_t i = idx; i < idx + tlb_ways; i++) {
+      if ((tlb_insn_tag[i] & ~TLB_CHECK_TRIGGERS) == tag ||
+          (tlb_load_tag[i] & ~TLB_CHECK_TRIGGERS) == tag ||
+          (tlb_store_tag[i] & ~TLB_CHECK_TRIGGERS) == tag)
+        tlb_insn_tag[i] = tlb_load_tag[i] = tlb_store_tag[i] = -1;
+    }
+  } else {
+    for (size_t i = 0; i < tlb_entries; i++) {
+      if ((tlb_insn_tag[i] & TLB_CONTEXT_MASK) == context_tag ||
+          (tlb_load_tag[i] & TLB_CONTEXT_MASK) == context_tag ||
+          (tlb_store_tag[i] & TLB_CONTEXT_MASK) == context_tag)
+        tlb_insn_tag[i] = tlb_load_tag[i] = tlb_store_tag[i] = -1;
+    }
+  }
+
+  // An instruction may straddle the page boundary, so also drop those that
+  // start in the last bytes of the previous page.
+  auto on_page = [&](reg_t addr) {
+    return !vpn || (addr >> PGSHIFT) == *vpn || ((addr + 7) >> PGSHIFT) == *vpn;
+  };
+  for (size_t i = 0; i < ICACHE_ENTRIES; i++)
+    if (icache[i].context == context_tag && on_page(icache[i].tag))
+      icache[i].tag = -1;
+  for (size_t i = 0; i < BLOCK_CACHE_ENTRIES; i++)
+    if (block_cache[i].context == context_tag && on_page(block_cache[i].tag))
+      block_cache[i].tag = -1;
+}
+
+void mmu_t::flush_tlb_vma(bool virt, std::optional<reg_t> vaddr, std::optional<reg_t> asid)
+{
+  // Superpage and NAPOT translations are cached one page at a time, so a
+  // fence on one of their pages has to drop them all.
+  std::optional<reg_t> vpn;
+  if (vaddr && !tlb_has_superpages)
+    vpn = *vaddr >> PGSHIFT;
+
+  reg_t asid_mask = proc->get_const_xlen() == 64 ? SATP64_ASID : SATP32_ASID;
+  reg_t vmid_mask = proc->get_const_xlen() == 64 ? HGATP64_VMID : HGATP32_VMID;
+  reg_t vmid = get_field(proc->state.hgatp->read(), vmid_mask);
+
+  auto match = [&](bool v, reg_t atp, reg_t hgatp) {
+    return v == virt &&
+           (!virt || get_field(hgatp, vmid_mask) == vmid) &&
+           (!asid || get_field(atp, asid_mask) == (*asid & (asid_mask >> ctz(asid_mask))));
+  };
+
+  for (size_t i = 0; i < tlb_contexts_used; i++) {
+    const tlb_context_t& context = tlb_contexts[i];
+    if (match(context.v, context.satp, context.hgatp))
+      flush_tlb_context(i, vpn);
+  }
+
+  flush_pwc([&](const pwc_entry_t& entry) {
+    return entry.stage != PWC_G && match(entry.stage == PWC_VS, entry.atp, entry.hgatp);
+  }, vaddr);
+}
+
+void mmu_t::flush_tlb_gvma(std::optional<reg_t> gpa, std::optional<reg_t> vmid)
+{
+  reg_t vmid_mask = proc->get_const_xlen() == 64 ? HGATP64_VMID : HGATP32_VMID;
+  auto match = [&](reg_t hgatp) {
+    return !vmid || get_field(hgatp, vmid_mask) == (*vmid & (vmid_mask >> ctz(vmid_mask)));
+  };
+
+  for (size_t i = 0; i < tlb_contexts_used; i++) {
+    const tlb_context_t& context = tlb_contexts[i];
+    if (context.v && match(context.hgatp))
+      flush_tlb_context(i, std::nullopt);
+  }
+
+  // VS-stage tables were read through the old G-stage mappings.
+  flush_pwc([&](const pwc_entry_t& entry) {
+    return entry.stage == PWC_VS && match(entry.hgatp);
+  }, std::nullopt);
+  flush_pwc([&](const pwc_entry_t& entry) {
+    return entry.stage == PWC_G && match(entry.atp);
+  }, gpa);
+}
+
+int mmu_t::pwc_lookup(pwc_stage_t stage, reg_t atp, reg_t hgatp, reg_t addr, int levels, int idxbits, reg_t* base)
+{
+  for (int level = 0; level < levels - 1; level++) {
+    int shift = PGSHIFT + (level + 1) * idxbits;
+    const pwc_entry_t& entry = pwc[pwc_index(addr >> shift, shift)];
+    if (entry.atp == atp && entry.hgatp == hgatp && entry.stage == stage &&
+        entry.shift == shift && entry.prefix == addr >> shift) {
+      *base = entry.base;
+      return level;
+    }
+  }
+  return levels - 1;
+}
+
+void mmu_t::pwc_insert(pwc_stage_t stage, reg_t atp, reg_t hgatp, reg_t addr, int level, int idxbits, reg_t base)
+{
+  int shift = PGSHIFT + (level + 1) * idxbits;
+  pwc[pwc_index(addr >> shift, shift)] = {atp, hgatp, stage, shift, addr >> shift, base};
+}
+
+void mmu_t::flush_pwc(std::function<bool(const pwc_entry_t&)> match, std::optional<reg_t> addr)
+{
+  for (size_t i = 0; i < PWC_ENTRIES; i++) {
+    pwc_entry_t& entry = pwc[i];
+    if (entry.atp && match(entry) && (!addr || (*addr >> entry.shift) == entry.prefix))
+      entry.atp = 0;
+  }
+}
+
 void throw_access_exception(bool virt, reg_t addr, access_type type)
 {
   switch (type) {
@@ -74,8 +352,10 @@ tlb_entry_t mmu_t::fetch_slow_path(reg_t vaddr)
   check_triggers(triggers::OPERATION_EXECUTE, vaddr, access_info.effective_virt);
 
   tlb_entry_t result;
-  reg_t vpn = vaddr >> PGSHIFT;
-  if (unlikely(tlb_insn_tag[vpn % TLB_ENTRIES] != (vpn | TLB_CHECK_TRIGGERS))) {
+  reg_t tag = (vaddr >> PGSHIFT) | current_tlb_context();
+  size_t idx = tlb_promote(tag);
+  if ((tlb_insn_tag[idx] & ~TLB_CHECK_TRIGGERS) != tag) {
+    tlb_misses[FETCH]++;
     reg_t paddr = translate(access_info, sizeof(fetch_temp));
     if (auto host_addr = sim->addr_to_mem(paddr)) {
       result = refill_tlb(vaddr, paddr, host_addr, FETCH);
@@ -85,7 +365,8 @@ tlb_entry_t mmu_t::fetch_slow_path(reg_t vaddr)
       result = {(char*)&fetch_temp - vaddr, paddr - vaddr};
     }
   } else {
-    result = tlb_data[vpn % TLB_ENTRIES];
+    tlb_hits[FETCH]++;
+    result = tlb_data[idx];
   }
 
   check_triggers(triggers::OPERATION_EXECUTE, vaddr, access_info.effective_virt, from_le(*(const uint16_t*)(result.host_offset + vaddr)));
@@ -126,37 +407,8 @@ bool mmu_t::iopmp_ok(reg_t sid, reg_t addr, reg_t len, access_type type)
   if (!iopmp_proc || iopmp_proc->sid_num <= 0 || sid == UINT64_MAX || sid >= iopmp_proc->sid_num)
     return true;
 
-  // Retrieve srcmd CSR from the srcmd table
-  srcmd_csr_t_p srcmd = iopmp_proc->state.srcmd[sid];
-  // Using the srcmd CSR, retrieve all associated memory domains
-  std::vector<reg_t> mdcfg_idxs = srcmd->associated_mds();
-  
-  std::vector<reg_t> entry_idxs;
-  // Obtain all entries belonging to the associated memory domains
-  for (reg_t mdcfg_idx : mdcfg_idxs) {
-    // Retrieve mdcfg from the mdcfg table
-    mdcfg_csr_t_p mdcfg = iopmp_proc->state.mdcfg[mdcfg_idx];
-    mdcfg->entries_belonging_to_md(&entry_idxs);
-  }
-
-  // No matching entries, the transaction is illegal
-  // Specified in section 2.6: Priority and Matching Logic, of the RISC-V IOPMP specification (Version 1.0.0-draft5)
-  bool transaction_ok = false;
-  // The entries are used to verify the legality of the transaction
-  for (reg_t entry_idx : entry_idxs) {
-    entry_addr_csr_t_p entry_addr = iopmp_proc->state.entry_addr[entry_idx];
-    // All bytes of the entry must match all bytes of the transaction
-    if (entry_addr->match(addr, len)) {
-      // If this is the case, verify that the entry grants enough permisions for the transaction to be legal
-      // Specified in section 2.6: Priority and Matching Logic, of the RISC-V IOPMP specification (Version 1.0.0-draft5)
-      if (entry_addr->access_ok(type)) {
-        transaction_ok = true;
-        break;
-      }
-    }
-  }
-
-  return transaction_ok;
+  // The SRCMD, MDCFG and entry CSRs are summarized by a per-SID index, see iopmp_index_t
+  return iopmp_proc->state.iopmp_index.access_ok(iopmp_proc, sid, addr, len, type);
 }
 
 bool mmu_t::mmio_ok(reg_t paddr, access_type UNUSED type)
@@ -198,6 +450,9 @@ bool mmu_t::mmio(reg_t paddr, size_t len, uint8_t* bytes, access_type type, reg_
     if (!mmio_ok(paddr, type))
       return false;
 
+    if (proc)
+      proc->perf.mmio[paddr]++;
+
     if (type == STORE)
       return sim->mmio_store(paddr, len, bytes);
     else
@@ -212,6 +467,33 @@ bool mmu_t::mmio(reg_t paddr, size_t len, uint8_t* bytes, access_type type, reg_
   return true;
 }
 
+bool mmu_t::dma_load(reg_t paddr, size_t len, uint8_t* bytes, reg_t sid)
+{
+  assert(len <= PGSIZE - (paddr % PGSIZE));
+  if (!iopmp_ok(sid, paddr, len, LOAD))
+    return false;
+
+  if (auto host_addr = sim->addr_to_mem(paddr)) {
+    memcpy(bytes, host_addr, len);
+    return true;
+  }
+  return sim->mmio_load(paddr, len, bytes);
+}
+
+bool mmu_t::dma_store(reg_t paddr, size_t len, const uint8_t* bytes, reg_t sid)
+{
+  assert(len <= PGSIZE - (paddr % PGSIZE));
+  if (!iopmp_ok(sid, paddr, len, STORE))
+    return false;
+
+  if (auto host_addr = sim->addr_to_mem(paddr)) {
+    memcpy(host_addr, bytes, len);
+    sim->mem_written(paddr);
+    return true;
+  }
+  return sim->mmio_store(paddr, len, bytes);
+}
+
 void mmu_t::check_triggers(triggers::operation_t operation, reg_t address, bool virt, reg_t tval, std::optional<reg_t> data)
 {
   if (matched_trigger || !proc)
@@ -236,10 +518,16 @@ void mmu_t::load_slow_path_intrapage(reg_t len, uint8_t* bytes, mem_access_info_
 {
   reg_t addr = access_info.vaddr;
   reg_t vpn = addr >> PGSHIFT;
-  if (!access_info.flags.is_special_access() && vpn == (tlb_load_tag[vpn % TLB_ENTRIES] & ~TLB_CHECK_TRIGGERS)) {
-    auto host_addr = tlb_data[vpn % TLB_ENTRIES].host_offset + addr;
-    memcpy(bytes, host_addr, len);
-    return;
+  if (!access_info.flags.is_special_access()) {
+    reg_t tag = vpn | current_tlb_context();
+    size_t idx = tlb_promote(tag);
+    if (tag == (tlb_load_tag[idx] & ~TLB_CHECK_TRIGGERS)) {
+      tlb_hits[LOAD]++;
+      auto host_addr = tlb_data[idx].host_offset + addr;
+      memcpy(bytes, host_addr, len);
+      return;
+    }
+    tlb_misses[LOAD]++;
   }
 
   reg_t paddr = translate(access_info, len);
@@ -297,12 +585,18 @@ void mmu_t::store_slow_path_intrapage(reg_t len, const uint8_t* bytes, mem_acces
 {
   reg_t addr = access_info.vaddr;
   reg_t vpn = addr >> PGSHIFT;
-  if (!access_info.flags.is_special_access() && vpn == (tlb_store_tag[vpn % TLB_ENTRIES] & ~TLB_CHECK_TRIGGERS)) {
-    if (actually_store) {
-      auto host_addr = tlb_data[vpn % TLB_ENTRIES].host_offset + addr;
-      memcpy(host_addr, bytes, len);
+  if (!access_info.flags.is_special_access()) {
+    reg_t tag = vpn | current_tlb_context();
+    size_t idx = tlb_promote(tag);
+    if (tag == (tlb_store_tag[idx] & ~TLB_CHECK_TRIGGERS)) {
+      tlb_hits[STORE]++;
+      if (actually_store) {
+        auto host_addr = tlb_data[idx].host_offset + addr;
+        memcpy(host_addr, bytes, len);
+      }
+      return;
     }
-    return;
+    tlb_misses[STORE]++;
   }
 
   reg_t paddr = translate(access_info, len);
@@ -310,6 +604,7 @@ void mmu_t::store_slow_path_intrapage(reg_t len, const uint8_t* bytes, mem_acces
   if (actually_store) {
     if (auto host_addr = sim->addr_to_mem(paddr)) {
       memcpy(host_addr, bytes, len);
+      sim->mem_written(paddr);
       if (tracer.interested_in_range(paddr, paddr + PGSIZE, STORE))
         tracer.trace(paddr, len, STORE);
       else if (!access_info.flags.is_special_access())
@@ -351,22 +646,58 @@ void mmu_t::store_slow_path(reg_t addr, reg_t len, const uint8_t* bytes, xlate_f
   }
 }
 
+void mmu_t::tlb_move_to_front(size_t idx, size_t way)
+{
+  size_t i = idx + way;
+  std::rotate(&tlb_data[idx], &tlb_data[i], &tlb_data[i + 1]);
+  std::rotate(&tlb_insn_tag[idx], &tlb_insn_tag[i], &tlb_insn_tag[i + 1]);
+  std::rotate(&tlb_load_tag[idx], &tlb_load_tag[i], &tlb_load_tag[i + 1]);
+  std::rotate(&tlb_store_tag[idx], &tlb_store_tag[i], &tlb_store_tag[i + 1]);
+}
+
+size_t mmu_t::tlb_promote(reg_t tag)
+{
+  size_t idx = tlb_index(tag);
+  for (size_t way = 0; way < tlb_ways; way++) {
+    size_t i = idx + way;
+    // All valid tags in a way translate the same page in the same context.
+    if ((tlb_insn_tag[i] & ~TLB_CHECK_TRIGGERS) == tag ||
+        (tlb_load_tag[i] & ~TLB_CHECK_TRIGGERS) == tag ||
+        (tlb_store_tag[i] & ~TLB_CHECK_TRIGGERS) == tag) {
+      tlb_move_to_front(idx, way);
+      break;
+    }
+  }
+  return idx;
+}
+
 tlb_entry_t mmu_t::refill_tlb(reg_t vaddr, reg_t paddr, char* host_addr, access_type type)
 {
-  reg_t idx = (vaddr >> PGSHIFT) % TLB_ENTRIES;
-  reg_t expected_tag = vaddr >> PGSHIFT;
+  reg_t expected_tag = (vaddr >> PGSHIFT) | current_tlb_context();
 
   tlb_entry_t entry = {host_addr - vaddr, paddr - vaddr};
 
+  if (proc)
+    proc->perf.tlb_refills[type]++;
+
   if (in_mprv())
     return entry;
 
-  if ((tlb_load_tag[idx] & ~TLB_CHECK_TRIGGERS) != expected_tag)
-    tlb_load_tag[idx] = -1;
-  if ((tlb_store_tag[idx] & ~TLB_CHECK_TRIGGERS) != expected_tag)
-    tlb_store_tag[idx] = -1;
-  if ((tlb_insn_tag[idx] & ~TLB_CHECK_TRIGGERS) != expected_tag)
-    tlb_insn_tag[idx] = -1;
+  reg_t idx = tlb_promote(expected_tag);
+  if ((tlb_insn_tag[idx] & ~TLB_CHECK_TRIGGERS) != expected_tag &&
+      (tlb_load_tag[idx] & ~TLB_CHECK_TRIGGERS) != expected_tag &&
+      (tlb_store_tag[idx] & ~TLB_CHECK_TRIGGERS) != expected_tag) {
+    // Evict a way and move it to the front of the set.
+    size_t victim = tlb_ways - 1;
+    if (tlb_policy == tlb_policy_random) {
+      tlb_random_state ^= tlb_random_state << 13;
+      tlb_random_state ^= tlb_random_state >> 7;
+      tlb_random_state ^= tlb_random_state << 17;
+      victim = tlb_random_state & (tlb_ways - 1);
+    }
+    tlb_move_to_front(idx, victim);
+    tlb_insn_tag[idx] = tlb_load_tag[idx] = tlb_store_tag[idx] = -1;
+  }
 
   if ((check_triggers_fetch && type == FETCH) ||
       (check_triggers_load && type == LOAD) ||
@@ -452,9 +783,11 @@ reg_t mmu_t::s2xlate(reg_t gva, reg_t gpa, access_type type, access_type trap_ty
   tinst |= ((proc->get_const_xlen() == 64) && (is_for_vs_pt_addr == true)) ? 0x1000 : 0;
   tinst |= ((type == STORE) && (is_for_vs_pt_addr == true)) ? 0x0020 : 0;
 
+  reg_t hgatp = proc->get_state()->hgatp->read();
   reg_t base = vm.ptbase;
   if ((gpa & ~maxgpa) == 0) {
-    for (int i = vm.levels - 1; i >= 0; i--) {
+    int start = pwc_lookup(PWC_G, hgatp, 0, gpa, vm.levels, vm.idxbits, &base);
+    for (int i = start; i >= 0; i--) {
       int ptshift = i * vm.idxbits;
       int idxbits = (i == (vm.levels - 1)) ? vm.idxbits + vm.widenbits : vm.idxbits;
       reg_t idx = (gpa >> (PGSHIFT + ptshift)) & ((reg_t(1) << idxbits) - 1);
@@ -478,6 +811,8 @@ reg_t mmu_t::s2xlate(reg_t gva, reg_t gpa, access_type type, access_type trap_ty
         if (pte & (PTE_D | PTE_A | PTE_U | PTE_N | PTE_PBMT))
           break;
         base = ppn << PGSHIFT;
+        if (i > 0)
+          pwc_insert(PWC_G, hgatp, 0, gpa, i - 1, vm.idxbits, base);
       } else if (!(pte & PTE_V) || (!(pte & PTE_R) && (pte & PTE_W))) {
         break;
       } else if (!(pte & PTE_U)) {
@@ -537,6 +872,8 @@ reg_t mmu_t::walk(mem_access_info_t access_info)
   if (vm.levels == 0)
     return s2xlate(addr, addr & ((reg_t(2) << (proc->xlen-1))-1), type, type, virt, hlvx, false) & ~page_mask; // zero-extend from xlen
 
+  proc->perf.page_walks++;
+
   bool s_mode = mode == PRV_S;
   bool sum = proc->state.sstatus->readvirt(virt) & MSTATUS_SUM;
   bool mxr = (proc->state.sstatus->readvirt(false) | proc->state.sstatus->readvirt(virt)) & MSTATUS_MXR;
@@ -548,8 +885,11 @@ reg_t mmu_t::walk(mem_access_info_t access_info)
   if (masked_msbs != 0 && masked_msbs != mask)
     vm.levels = 0;
 
+  pwc_stage_t stage = virt ? PWC_VS : PWC_S;
+  reg_t hgatp = virt ? proc->get_state()->hgatp->read() : 0;
   reg_t base = vm.ptbase;
-  for (int i = vm.levels - 1; i >= 0; i--) {
+  int start = pwc_lookup(stage, satp, hgatp, addr, vm.levels, vm.idxbits, &base);
+  for (int i = start; i >= 0; i--) {
     int ptshift = i * vm.idxbits;
     reg_t idx = (addr >> (PGSHIFT + ptshift)) & ((1 << vm.idxbits) - 1);
 
@@ -572,6 +912,8 @@ reg_t mmu_t::walk(mem_access_info_t access_info)
       if (pte & (PTE_D | PTE_A | PTE_U | PTE_N | PTE_PBMT))
         break;
       base = ppn << PGSHIFT;
+      if (i > 0)
+        pwc_insert(stage, satp, hgatp, addr, i - 1, vm.idxbits, base);
     } else if ((pte & PTE_U) ? s_mode && (type == FETCH || !sum) : !s_mode) {
       break;
     } else if (!(pte & PTE_V) || (!(pte & PTE_R) && (pte & PTE_W))) {
@@ -604,6 +946,8 @@ reg_t mmu_t::walk(mem_access_info_t access_info)
       int napot_bits = ((pte & PTE_N) ? (ctz(ppn) + 1) : 0);
       if (((pte & PTE_N) && (ppn == 0 || i != 0)) || (napot_bits != 0 && napot_bits != 4))
         break;
+      if (i != 0 || napot_bits != 0)
+        tlb_has_superpages = true;
 
       reg_t page_base = ((ppn & ~((reg_t(1) << napot_bits) - 1))
                         | (vpn & ((reg_t(1) << napot_bits) - 1))
@@ -13,7 +13,12 @@
 #include "triggers.h"
 #include "cfg.h"
 #include <stdlib.h>
+#include <functional>
+#include <memory>
 #include <vector>
+#include <mutex>
+#include <optional>
+#include <type_traits>
 
 // virtual memory configuration
 #define PGSHIFT 12
@@ -29,10 +34,33 @@ struct insn_fetch_t
 
 struct icache_entry_t {
   reg_t tag;
+  reg_t context;
   struct icache_entry_t* next;
   insn_fetch_t data;
 };
 
+// a straight-line run of decoded instructions starting at tag.  npc is the
+// fall-through PC of each instruction; execution leaves the block as soon as
+// an instruction returns any other PC.
+struct block_insn_t {
+  insn_fetch_t fetch;
+  reg_t npc;
+};
+
+typedef void (*block_jit_func_t)(reg_t* xpr);
+
+// hits counts entries into the block for jit_t; once compiled, jit runs the
+// first jit_len instructions of the block.
+struct block_cache_entry_t {
+  reg_t tag;
+  reg_t context;
+  size_t len;
+  unsigned hits;
+  size_t jit_len;
+  block_jit_func_t jit;
+  block_insn_t insns[16];
+};
+
 struct tlb_entry_t {
   char* host_offset;
   reg_t target_offset;
@@ -98,10 +126,12 @@ public:
     target_endian<T> res;
     reg_t vpn = addr >> PGSHIFT;
     bool aligned = (addr & (sizeof(T) - 1)) == 0;
-    bool tlb_hit = tlb_load_tag[vpn % TLB_ENTRIES] == vpn;
+    size_t idx = tlb_index(vpn);
+    bool tlb_hit = tlb_load_tag[idx] == (vpn | tlb_context);
 
     if (likely(!xlate_flags.is_special_access() && aligned && tlb_hit)) {
-      res = *(target_endian<T>*)(tlb_data[vpn % TLB_ENTRIES].host_offset + addr);
+      tlb_hits[LOAD]++;
+      res = *(target_endian<T>*)(tlb_data[idx].host_offset + addr);
     } else {
       load_slow_path(addr, sizeof(T), (uint8_t*)&res, xlate_flags, sid);
     }
@@ -114,7 +144,9 @@ public:
 
   template<typename T>
   T load_reserved(reg_t addr) {
-    return load<T>(addr, {.lr = true});
+    T res = load<T>(addr, {.lr = true});
+    load_reservation_value = (std::make_unsigned_t<T>)res;
+    return res;
   }
 
   template<typename T>
@@ -131,10 +163,12 @@ public:
   void ALWAYS_INLINE store(reg_t addr, T val, xlate_flags_t xlate_flags = {}, reg_t sid = UINT64_MAX) {
     reg_t vpn = addr >> PGSHIFT;
     bool aligned = (addr & (sizeof(T) - 1)) == 0;
-    bool tlb_hit = tlb_store_tag[vpn % TLB_ENTRIES] == vpn;
+    size_t idx = tlb_index(vpn);
+    bool tlb_hit = tlb_store_tag[idx] == (vpn | tlb_context);
 
     if (!xlate_flags.is_special_access() && likely(aligned && tlb_hit)) {
-      *(target_endian<T>*)(tlb_data[vpn % TLB_ENTRIES].host_offset + addr) = to_target(val);
+      tlb_hits[STORE]++;
+      *(target_endian<T>*)(tlb_data[idx].host_offset + addr) = to_target(val);
     } else {
       target_endian<T> target_val = to_target(val);
       store_slow_path(addr, sizeof(T), (const uint8_t*)&target_val, xlate_flags, true, false, sid);
@@ -167,6 +201,7 @@ public:
   // template for functions that perform an atomic memory operation
   template<typename T, typename op>
   T amo(reg_t addr, op f) {
+    auto guard = atomic_guard();
     convert_load_traps_to_store_traps({
       store_slow_path(addr, sizeof(T), nullptr, {}, false, true);
       auto lhs = load<T>(addr);
@@ -177,6 +212,7 @@ public:
 
   template<typename T>
   T amo_compare_and_swap(reg_t addr, T comp, T swap) {
+    auto guard = atomic_guard();
     convert_load_traps_to_store_traps({
       store_slow_path(addr, sizeof(T), nullptr, {}, false, true);
       auto lhs = load<T>(addr);
@@ -250,8 +286,15 @@ public:
   template<typename T>
   bool store_conditional(reg_t addr, T val)
   {
+    auto guard = atomic_guard();
     bool have_reservation = check_load_reservation(addr, sizeof(T));
 
+    // Other harts' stores do not clear the reservation, which is only sound
+    // while harts take turns.  When they run concurrently, the SC also
+    // fails if the location no longer holds what the LR read.
+    if (have_reservation && atomic_lock)
+      have_reservation = load<T>(addr) == (T)load_reservation_value;
+
     if (have_reservation)
       store(addr, val);
 
@@ -278,6 +321,9 @@ public:
     if (matched_trigger)
       throw *matched_trigger;
 
+    if (proc)
+      proc->perf.icache_refills++;
+
     auto tlb_entry = translate_insn_addr(addr);
     insn_bits_t insn = from_le(*(uint16_t*)(tlb_entry.host_offset + addr));
     int length = insn_length(insn);
@@ -298,6 +344,7 @@ public:
 
     insn_fetch_t fetch = {proc->decode_insn(insn), insn};
     entry->tag = addr;
+    entry->context = tlb_context;
     entry->next = &icache[icache_index(addr + length)];
     entry->data = fetch;
 
@@ -312,7 +359,7 @@ public:
   inline icache_entry_t* access_icache(reg_t addr)
   {
     icache_entry_t* entry = &icache[icache_index(addr)];
-    if (likely(entry->tag == addr))
+    if (likely(entry->tag == addr && entry->context == tlb_context))
       return entry;
     return refill_icache(addr, entry);
   }
@@ -323,9 +370,44 @@ public:
     return refill_icache(addr, &entry)->data;
   }
 
+  static const reg_t BLOCK_CACHE_ENTRIES = 512;
+  static const size_t MAX_BLOCK_INSNS = sizeof(block_cache_entry_t::insns) / sizeof(block_insn_t);
+
+  inline size_t block_cache_index(reg_t addr)
+  {
+    return (addr / PC_ALIGN) % BLOCK_CACHE_ENTRIES;
+  }
+
+  inline block_cache_entry_t* access_block_cache(reg_t addr)
+  {
+    block_cache_entry_t* block = &block_cache[block_cache_index(addr)];
+    if (likely(block->tag == addr && block->context == tlb_context))
+      return block;
+    return refill_block_cache(addr, block);
+  }
+
   void flush_tlb();
   void flush_icache();
 
+  // The privilege mode, virtualization mode or a CSR that address
+  // translation depends on may have changed.  The new translation context is
+  // looked up on the next TLB miss; entries of other contexts are kept.
+  void switch_tlb_context()
+  {
+    tlb_context = TLB_CONTEXT_STALE;
+  }
+
+  // SFENCE.VMA (virt false) and HFENCE.VVMA (virt true, for the current
+  // VMID): invalidate the translations of address space asid, or of all
+  // address spaces, for vaddr's page, or for all pages.
+  void flush_tlb_vma(bool virt, std::optional<reg_t> vaddr, std::optional<reg_t> asid);
+  // HFENCE.GVMA: invalidate the translations of guest vmid, or of all guests,
+  // for guest-physical address gpa, or for all of them.
+  void flush_tlb_gvma(std::optional<reg_t> gpa, std::optional<reg_t> vmid);
+
+  // Print the TLB hit and miss counts, prefixing each line with name.
+  void print_tlb_stats(const char* name);
+
   void register_memtracer(memtracer_t*);
 
   int is_misaligned_enabled()
@@ -353,29 +435,141 @@ public:
     blocksz = size;
   }
 
+  // Make AMOs and SCs atomic with respect to other mmu_ts sharing lock, for
+  // harts that run on concurrent host threads.
+  void set_atomic_lock(std::mutex* lock)
+  {
+    atomic_lock = lock;
+  }
+
   bool iopmp_ok(reg_t sid, reg_t addr, reg_t len, access_type type);
 
+  // Accesses made by a bus-mastering device with source ID sid, which the
+  // IOPMP checks once for the whole transaction.  A transaction may be any
+  // length, but must not cross a page boundary.
+  bool dma_load(reg_t paddr, size_t len, uint8_t* bytes, reg_t sid);
+  bool dma_store(reg_t paddr, size_t len, const uint8_t* bytes, reg_t sid);
+
 private:
+  std::unique_lock<std::mutex> atomic_guard()
+  {
+    if (atomic_lock)
+      return std::unique_lock<std::mutex>(*atomic_lock);
+    return std::unique_lock<std::mutex>();
+  }
+
   simif_t* sim;
   processor_t* proc;
   processor_t* iopmp_proc;
   memtracer_list_t tracer;
   reg_t load_reservation_address;
+  reg_t load_reservation_value;
+  std::mutex* atomic_lock = NULL;
   uint16_t fetch_temp;
   reg_t blocksz;
 
   // implement an instruction cache for simulator performance
   icache_entry_t icache[ICACHE_ENTRIES];
 
-  // implement a TLB for simulator performance
-  static const reg_t TLB_ENTRIES = 256;
+  // straight-line runs of the instruction cache, dispatched as a unit by
+  // processor_t::step()
+  block_cache_entry_t block_cache[BLOCK_CACHE_ENTRIES];
+  block_cache_entry_t* refill_block_cache(reg_t addr, block_cache_entry_t* block);
+
+  // implement a TLB for simulator performance.  The TLB is set-associative,
+  // and the ways of each set are kept in most-recently-used order, so the
+  // inline fast paths only ever look at the first way of a set.
   // If a TLB tag has TLB_CHECK_TRIGGERS set, then the MMU must check for a
   // trigger match before completing an access.
   static const reg_t TLB_CHECK_TRIGGERS = reg_t(1) << 63;
-  tlb_entry_t tlb_data[TLB_ENTRIES];
-  reg_t tlb_insn_tag[TLB_ENTRIES];
-  reg_t tlb_load_tag[TLB_ENTRIES];
-  reg_t tlb_store_tag[TLB_ENTRIES];
+  size_t tlb_entries;
+  size_t tlb_ways;
+  unsigned tlb_ways_shift;
+  reg_t tlb_set_mask;
+  tlb_policy_t tlb_policy;
+  reg_t tlb_random_state;
+  std::unique_ptr<tlb_entry_t[]> tlb_data;
+  std::unique_ptr<reg_t[]> tlb_insn_tag;
+  std::unique_ptr<reg_t[]> tlb_load_tag;
+  std::unique_ptr<reg_t[]> tlb_store_tag;
+  // TLB, instruction cache and block cache entries are tagged with the
+  // translation context they were filled under, so that address-space,
+  // privilege and guest switches only change tlb_context.  TLB tags hold the
+  // context number above the VPN.
+  struct tlb_context_t {
+    reg_t prv;
+    bool v;
+    reg_t satp;     // vsatp if v
+    reg_t hgatp;    // 0 unless v
+    reg_t status;   // the mstatus and vsstatus bits walk() depends on
+    bool operator==(const tlb_context_t&) const = default;
+  };
+  static const size_t TLB_CONTEXTS = 16;
+  static const int TLB_CONTEXT_SHIFT = 64 - PGSHIFT;
+  static const reg_t TLB_CONTEXT_MASK = ~TLB_CHECK_TRIGGERS & ~((reg_t(1) << TLB_CONTEXT_SHIFT) - 1);
+  static const reg_t TLB_CONTEXT_STALE = TLB_CONTEXT_MASK;
+  tlb_context_t tlb_contexts[TLB_CONTEXTS];
+  size_t tlb_contexts_used;
+  size_t tlb_next_victim_context;
+  reg_t tlb_context;  // current context number << TLB_CONTEXT_SHIFT
+  // whether any cached translation came from a superpage or NAPOT mapping
+  bool tlb_has_superpages;
+
+  reg_t current_tlb_context()
+  {
+    if (unlikely(tlb_context == TLB_CONTEXT_STALE))
+      lookup_tlb_context();
+    return tlb_context;
+  }
+  void lookup_tlb_context();
+  // invalidate the entries of a context, or only those for page vpn
+  void flush_tlb_context(size_t context, std::optional<reg_t> vpn);
+
+  // page-walk cache: the base of the page table that the non-leaf PTEs of a
+  // walk rooted at atp lead to, for the address bits above shift.  VS-stage
+  // walks are also keyed by the hgatp they were made under.  Only PTE loads
+  // are skipped; leaf PTEs, and so A/D updates, are never cached.
+  enum pwc_stage_t { PWC_S, PWC_VS, PWC_G };
+  struct pwc_entry_t {
+    reg_t atp;  // satp, vsatp or hgatp; 0 if the entry is invalid
+    reg_t hgatp;
+    pwc_stage_t stage;
+    int shift;
+    reg_t prefix;
+    reg_t base;
+  };
+  static const size_t PWC_ENTRIES = 256;
+  pwc_entry_t pwc[PWC_ENTRIES];
+
+  inline size_t pwc_index(reg_t prefix, int shift)
+  {
+    return (prefix ^ (reg_t(shift) << 3)) % PWC_ENTRIES;
+  }
+
+  // return the lowest level of the walk for addr whose table is cached, and
+  // set base to that table, or return levels - 1 if there is none
+  int pwc_lookup(pwc_stage_t stage, reg_t atp, reg_t hgatp, reg_t addr, int levels, int idxbits, reg_t* base);
+  void pwc_insert(pwc_stage_t stage, reg_t atp, reg_t hgatp, reg_t addr, int level, int idxbits, reg_t base);
+  // invalidate the entries that match, or only those on the walk for addr
+  void flush_pwc(std::function<bool(const pwc_entry_t&)> match, std::optional<reg_t> addr);
+
+  // hit and miss counts, indexed by access_type
+  reg_t tlb_hits[3];
+  reg_t tlb_misses[3];
+
+  // index of the first way of vpn's set
+  inline size_t tlb_index(reg_t vpn)
+  {
+    return (vpn & tlb_set_mask) << tlb_ways_shift;
+  }
+
+  // move way of the set starting at idx to the front, keeping the order of
+  // the other ways
+  void tlb_move_to_front(size_t idx, size_t way);
+
+  // if tag (a VPN and context) is in the TLB, move it to the front of its
+  // set; either way, return the index of the first way of the set
+  size_t tlb_promote(reg_t tag);
 
   // finish translation on a TLB miss and update the TLB
   tlb_entry_t refill_tlb(reg_t vaddr, reg_t paddr, char* host_addr, access_type type);
@@ -446,6 +640,7 @@ private:
     target_endian<T> target_pte = to_target((T)new_pte);
     if (host_pte_addr) {
       memcpy(host_pte_addr, &target_pte, ptesize);
+      sim->mem_written(pte_paddr);
     } else if (!mmio_store(pte_paddr, ptesize, (uint8_t*)&target_pte)) {
       throw_access_exception(virt, addr, trap_type);
     }
@@ -454,8 +649,11 @@ private:
   // ITLB lookup
   inline tlb_entry_t translate_insn_addr(reg_t addr) {
     reg_t vpn = addr >> PGSHIFT;
-    if (likely(tlb_insn_tag[vpn % TLB_ENTRIES] == vpn))
-      return tlb_data[vpn % TLB_ENTRIES];
+    size_t idx = tlb_index(vpn);
+    if (likely(tlb_insn_tag[idx] == (vpn | tlb_context))) {
+      tlb_hits[FETCH]++;
+      return tlb_data[idx];
+    }
     return fetch_slow_path(addr);
   }
 
@@ -6,6 +6,7 @@
 #include "term.h"
 #include "sim.h"
 #include "dts.h"
+#include "checkpoint.h"
 
 #define UART_QUEUE_SIZE         64
 
@@ -328,6 +329,26 @@ void ns16550_t::tick(reg_t UNUSED rtc_ticks)
   update_interrupt();
 }
 
+void ns16550_t::save(std::ostream& o)
+{
+  checkpoint_write(o, rx_queue.size());
+  for (auto q = rx_queue; !q.empty(); q.pop())
+    checkpoint_write(o, q.front());
+  for (uint8_t reg : {dll, dlm, iir, ier, fcr, lcr, mcr, lsr, msr, scr})
+    checkpoint_write(o, reg);
+}
+
+void ns16550_t::restore(std::istream& i)
+{
+  rx_queue = {};
+  for (size_t n = checkpoint_read<size_t>(i); n > 0; n--)
+    rx_queue.push(checkpoint_read<uint8_t>(i));
+  for (uint8_t* reg : {&dll, &dlm, &iir, &ier, &fcr, &lcr, &mcr, &lsr, &msr, &scr})
+    checkpoint_read(i, *reg);
+  backoff_counter = 0;
+  update_interrupt();
+}
+
 std::string ns16550_generate_dts(const sim_t* sim)
 {
   std::stringstream s;
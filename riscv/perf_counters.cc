@@ -0,0 +1,91 @@
+// See LICENSE for license details.
+
+#include "sim.h"
+#include "perf_counters.h"
+#include <cinttypes>
+#include <stdexcept>
+
+static const char* const priv_names[] = {"u", "s", "h", "m"};
+static const char* const access_names[] = {"load", "store", "fetch"};
+
+perf_log_t::perf_log_t(const std::string& path)
+  : last_time(std::chrono::steady_clock::now())
+{
+  file = fopen(path.c_str(), "w");
+  if (!file)
+    throw std::runtime_error("could not create " + path);
+  json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+  if (!json)
+    fprintf(file, "instructions,host_seconds,hart,counter,value\n");
+}
+
+perf_log_t::~perf_log_t()
+{
+  fclose(file);
+}
+
+void perf_log_t::dump(reg_t steps, const std::vector<std::pair<size_t, perf_values_t>>& harts)
+{
+  auto now = std::chrono::steady_clock::now();
+  double seconds = std::chrono::duration<double>(now - last_time).count();
+  last_time = now;
+  last.resize(harts.size());
+
+  if (json)
+    fprintf(file, "{\"instructions\": %" PRIu64 ", \"host_seconds\": %.6f, \"harts\": [", steps, seconds);
+  for (size_t i = 0; i < harts.size(); i++) {
+    if (json)
+      fprintf(file, "%s{\"hart\": %zu", i ? ", " : "", harts[i].first);
+    for (auto& [name, value] : harts[i].second) {
+      uint64_t delta = value - last[i][name];
+      if (delta == 0)
+        continue;
+      if (json)
+        fprintf(file, ", \"%s\": %" PRIu64, name.c_str(), delta);
+      else
+        fprintf(file, "%" PRIu64 ",%.6f,%zu,%s,%" PRIu64 "\n", steps, seconds, harts[i].first, name.c_str(), delta);
+    }
+    if (json)
+      fprintf(file, "}");
+    last[i] = harts[i].second;
+  }
+  if (json)
+    fprintf(file, "]}\n");
+  fflush(file);
+}
+
+// Names the counters of p.  MMIO accesses are charged to the device that
+// holds their address.
+perf_values_t sim_t::perf_values(processor_t* p)
+{
+  const perf_counters_t& perf = p->get_perf_counters();
+  perf_values_t values;
+  for (int prv = 0; prv < 4; prv++)
+    if (perf.instret[prv])
+      values[std::string("instret.") + priv_names[prv]] = perf.instret[prv];
+  for (int cause = 0; cause < 64; cause++) {
+    if (perf.exceptions[cause])
+      values["exception." + std::to_string(cause)] = perf.exceptions[cause];
+    if (perf.interrupts[cause])
+      values["interrupt." + std::to_string(cause)] = perf.interrupts[cause];
+  }
+  values["icache_refills"] = perf.icache_refills;
+  for (int type = 0; type < 3; type++)
+    values[std::string("tlb_refills.") + access_names[type]] = perf.tlb_refills[type];
+  values["page_walks"] = perf.page_walks;
+  values["opcode_cache_misses"] = perf.opcode_cache_misses;
+  for (auto& [paddr, count] : perf.mmio) {
+    char name[32];
+    snprintf(name, sizeof(name), "mmio.0x%" PRIx64, bus.find_device(paddr).first);
+    values[name] += count;
+  }
+  return values;
+}
+
+void sim_t::dump_perf_counters()
+{
+  std::vector<std::pair<size_t, perf_values_t>> harts;
+  for (auto p : procs)
+    harts.push_back({p->get_id(), perf_values(p)});
+  perf_log->dump(total_steps, harts);
+}
@@ -0,0 +1,52 @@
+// See LICENSE for license details.
+
+#ifndef _RISCV_PERF_COUNTERS_H
+#define _RISCV_PERF_COUNTERS_H
+
+#include "decode.h"
+#include <chrono>
+#include <map>
+#include <stdio.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Counts of the events that make a hart simulate slowly.  They are always
+// kept, as each is bumped on a path that is already slow, and written out
+// by perf_log_t with --perf-counters.
+struct perf_counters_t
+{
+  uint64_t instret[4] = {};      // by the privilege a step began in
+  uint64_t exceptions[64] = {};  // by cause
+  uint64_t interrupts[64] = {};  // by cause
+  uint64_t icache_refills = 0;
+  uint64_t tlb_refills[3] = {};  // by access_type
+  uint64_t page_walks = 0;
+  uint64_t opcode_cache_misses = 0;
+  std::unordered_map<reg_t, uint64_t> mmio; // by physical address
+};
+
+// Named counter values, as sim_t gathers them for one hart
+typedef std::map<std::string, uint64_t> perf_values_t;
+
+// Writes how much each counter of each hart grew over each interval, to a
+// CSV file with one row per hart and counter that changed, or, if the path
+// ends in .json, to a JSON Lines file with one object per interval.
+class perf_log_t
+{
+public:
+  perf_log_t(const std::string& path);
+  ~perf_log_t();
+
+  // steps is the number of instructions run on all harts so far, and
+  // harts[i] is the hart ID and counters of the ith hart
+  void dump(reg_t steps, const std::vector<std::pair<size_t, perf_values_t>>& harts);
+
+private:
+  FILE* file;
+  bool json;
+  std::vector<perf_values_t> last;
+  std::chrono::steady_clock::time_point last_time;
+};
+
+#endif
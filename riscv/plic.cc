@@ -5,6 +5,7 @@
 #include "simif.h"
 #include "sim.h"
 #include "dts.h"
+#include "checkpoint.h"
 
 #define PLIC_MAX_CONTEXTS 15872
 
@@ -392,6 +393,33 @@ bool plic_t::store(reg_t addr, size_t len, const uint8_t* bytes)
   return ret;
 }
 
+void plic_t::save(std::ostream& o)
+{
+  checkpoint_write(o, priority);
+  checkpoint_write(o, level);
+  for (const auto& c : contexts) {
+    checkpoint_write(o, c.priority_threshold);
+    checkpoint_write(o, c.enable);
+    checkpoint_write(o, c.pending);
+    checkpoint_write(o, c.pending_priority);
+    checkpoint_write(o, c.claimed);
+  }
+}
+
+void plic_t::restore(std::istream& i)
+{
+  checkpoint_read(i, priority);
+  checkpoint_read(i, level);
+  for (auto& c : contexts) {
+    checkpoint_read(i, c.priority_threshold);
+    checkpoint_read(i, c.enable);
+    checkpoint_read(i, c.pending);
+    checkpoint_read(i, c.pending_priority);
+    checkpoint_read(i, c.claimed);
+    context_update(&c);
+  }
+}
+
 std::string plic_generate_dts(const sim_t* sim)
 {
   std::stringstream s;
@@ -8,9 +8,11 @@
 #include "decode_macros.h"
 #include "simif.h"
 #include "mmu.h"
+#include "jit.h"
 #include "disasm.h"
 #include "platform.h"
 #include "vector_unit.h"
+#include "checkpoint.h"
 #include <cinttypes>
 #include <cmath>
 #include <cstdlib>
@@ -34,9 +36,10 @@ processor_t::processor_t(const isa_parser_t *isa, const cfg_t *cfg,
                          FILE* log_file, std::ostream& sout_)
   : debug(false), halt_request(HR_NONE), isa(isa), cfg(cfg), sim(sim), id(id), xlen(0),
   histogram_enabled(false), log_commits_enabled(false),
-  log_file(log_file), sout_(sout_.rdbuf()), halt_on_reset(halt_on_reset),
+  log_file(log_file), commit_log_writer(NULL), sout_(sout_.rdbuf()), halt_on_reset(halt_on_reset),
   in_wfi(false), check_triggers_icount(false),
   impl_table(256, false), extension_enable_table(isa->get_extension_table()),
+  profile_countdown(cfg->profile_interval.value_or(0)),
   last_pc(1), executions(1), TM(cfg->trigger_count)
 {
   VU.p = this;
@@ -58,6 +61,8 @@ processor_t::processor_t(const isa_parser_t *isa, const cfg_t *cfg,
 
   register_base_instructions();
   mmu = new mmu_t(sim, cfg->endianness, this, NULL);
+  jit = cfg->jit ? new jit_t(this) : NULL;
+  call_graph = cfg->profile_calls ? new call_graph_t() : NULL;
 
   disassembler = new disassembler_t(isa);
   for (auto e : isa->get_extensions())
@@ -94,6 +99,11 @@ processor_t::~processor_t()
       fprintf(stderr, "%0" PRIx64 " %" PRIu64 "\n", it.first, it.second);
   }
 
+  if (cfg->tlb_stats)
+    mmu->print_tlb_stats(("C" + std::to_string(id)).c_str());
+
+  delete jit;
+  delete call_graph;
   delete mmu;
   delete disassembler;
 }
@@ -457,6 +467,7 @@ void state_t::reset(processor_t* const proc, reg_t max_isa)
   }
 
   csrmap[CSR_ENTRYLCK] = entrylck = std::make_shared<entrylck_csr_t>(proc, CSR_ENTRYLCK);
+  iopmp_index.invalidate();
 
   csrmap[CSR_FFLAGS] = fflags = std::make_shared<float_csr_t>(proc, CSR_FFLAGS, FSR_AEXC >> FSR_AEXC_SHIFT, 0);
   csrmap[CSR_FRM] = frm = std::make_shared<float_csr_t>(proc, CSR_FRM, FSR_RD >> FSR_RD_SHIFT, 0);
@@ -637,9 +648,10 @@ void processor_t::set_histogram(bool value)
   histogram_enabled = value;
 }
 
-void processor_t::enable_log_commits()
+void processor_t::enable_log_commits(commit_log_writer_t* writer)
 {
   log_commits_enabled = true;
+  commit_log_writer = writer;
 }
 
 void processor_t::reset()
@@ -665,6 +677,186 @@ void processor_t::reset()
     sim->proc_reset(id);
 }
 
+// CSRs that save() and restore() handle outside of the generic CSR list
+static bool csr_saved_separately(reg_t which)
+{
+  // Read-only CSRs are constants or views of other state (the counters,
+  // vl and vtype), so there is nothing to write back.
+  if (get_field(which, 0xC00) == 3)
+    return true;
+
+  switch (which) {
+    case CSR_MCYCLE: case CSR_MCYCLEH:
+    case CSR_MINSTRET: case CSR_MINSTRETH:
+    case CSR_MIP:
+    case CSR_MISA:
+    case CSR_TDATA1: case CSR_TDATA2: case CSR_TDATA3:
+    case CSR_SEED:
+    case CSR_VSTART:
+      return true;
+  }
+  return false;
+}
+
+// CSRs that can lock other CSRs against writes, so are restored last
+static bool csr_is_lock(reg_t which)
+{
+  return (which >= CSR_PMPCFG0 && which <= CSR_PMPCFG15) ||
+         which == CSR_MSECCFG || which == CSR_MDCFGLCK || which == CSR_ENTRYLCK;
+}
+
+// CSRs whose writes mark the FP or vector state dirty, which must not be
+// off at the time, so are restored first
+static bool csr_dirties_state(reg_t which)
+{
+  switch (which) {
+    case CSR_FFLAGS: case CSR_FRM: case CSR_FCSR:
+    case CSR_VXSAT: case CSR_VXRM: case CSR_VCSR:
+      return true;
+  }
+  return false;
+}
+
+void processor_t::save(std::ostream& o)
+{
+  checkpoint_write(o, state.pc);
+  for (size_t i = 0; i < NXPR; i++)
+    checkpoint_write(o, state.XPR[i]);
+  for (size_t i = 0; i < NFPR; i++)
+    checkpoint_write(o, state.FPR[i]);
+  checkpoint_write(o, state.prv);
+  checkpoint_write(o, state.v);
+  checkpoint_write(o, state.debug_mode);
+  checkpoint_write(o, state.single_step);
+  checkpoint_write(o, state.serialized);
+  checkpoint_write(o, state.last_inst_priv);
+  checkpoint_write(o, state.last_inst_xlen);
+  checkpoint_write(o, state.last_inst_flen);
+  checkpoint_write(o, in_wfi);
+  checkpoint_write(o, halt_request);
+
+  // Virtualized CSRs must be read as the HS-mode copies they are restored to.
+  const bool v = state.v;
+  state.v = false;
+  std::vector<reg_t> csrs;
+  for (const auto& [which, csr] : state.csrmap)
+    if (!csr_saved_separately(which))
+      csrs.push_back(which);
+  std::sort(csrs.begin(), csrs.end());
+  checkpoint_write(o, csrs.size());
+  for (reg_t which : csrs) {
+    checkpoint_write(o, which);
+    checkpoint_write(o, state.csrmap[which]->read());
+  }
+  state.v = v;
+
+  checkpoint_write(o, state.misa->read());
+  checkpoint_write(o, state.mcycle->read());
+  checkpoint_write(o, state.minstret->read());
+  // hvip.VSEIP and hvip.VSTIP show through mip but are held by hvip
+  checkpoint_write(o, state.mip->read() & ~state.hvip->basic_csr_t::read());
+
+  checkpoint_write(o, TM.count());
+  for (unsigned i = 0; i < TM.count(); i++) {
+    checkpoint_write(o, TM.tdata1_read(i));
+    checkpoint_write(o, TM.tdata2_read(i));
+    checkpoint_write(o, TM.tdata3_read(i));
+  }
+
+  checkpoint_write(o, VU.vlenb);
+  o.write((const char*)VU.reg_file, NVPR * VU.vlenb);
+  checkpoint_write(o, VU.vl->read());
+  checkpoint_write(o, VU.vtype->read());
+  checkpoint_write(o, VU.vstart->read());
+}
+
+void processor_t::restore(std::istream& i)
+{
+  checkpoint_read(i, state.pc);
+  for (size_t r = 0; r < NXPR; r++)
+    state.XPR.write(r, checkpoint_read<reg_t>(i));
+  for (size_t r = 0; r < NFPR; r++)
+    state.FPR.write(r, checkpoint_read<freg_t>(i));
+  const reg_t prv = checkpoint_read<reg_t>(i);
+  const bool v = checkpoint_read<bool>(i);
+  const bool debug_mode = checkpoint_read<bool>(i);
+  checkpoint_read(i, state.single_step);
+  checkpoint_read(i, state.serialized);
+  checkpoint_read(i, state.last_inst_priv);
+  checkpoint_read(i, state.last_inst_xlen);
+  checkpoint_read(i, state.last_inst_flen);
+  checkpoint_read(i, in_wfi);
+  checkpoint_read(i, halt_request);
+
+  std::vector<std::pair<reg_t, reg_t>> csrs(checkpoint_read<size_t>(i));
+  for (auto& [which, val] : csrs) {
+    checkpoint_read(i, which);
+    checkpoint_read(i, val);
+    if (!state.csrmap.count(which))
+      throw std::runtime_error("checkpoint has a CSR this hart lacks; was it saved with another --isa?");
+  }
+  const reg_t misa = checkpoint_read<reg_t>(i);
+  const reg_t mcycle = checkpoint_read<reg_t>(i);
+  const reg_t minstret = checkpoint_read<reg_t>(i);
+  const reg_t mip = checkpoint_read<reg_t>(i);
+
+  // Write the CSRs back from M-mode through their normal write paths.  The
+  // saved values are legal, so each write reproduces the saved state; two
+  // passes let CSRs whose writable bits depend on other CSRs settle, and
+  // the CSRs that lock others go last.  The FP and vector state is enabled
+  // for the CSRs that dirty it, until mstatus is written back.
+  state.prv = PRV_M;
+  state.v = false;
+  state.debug_mode = true; // lets triggers with dmode set be written
+  state.misa->write(misa);
+  state.mstatus->write(state.mstatus->read() | MSTATUS_FS | MSTATUS_VS);
+  for (const auto& [which, val] : csrs)
+    if (csr_dirties_state(which))
+      state.csrmap[which]->write(val);
+  for (int pass = 0; pass < 2; pass++)
+    for (const auto& [which, val] : csrs)
+      if (!csr_is_lock(which) && !csr_dirties_state(which))
+        state.csrmap[which]->write(val);
+  for (const auto& [which, val] : csrs)
+    if (csr_is_lock(which))
+      state.csrmap[which]->write(val);
+
+  // Counter writes compensate for the increment at the end of the current
+  // instruction, which a restore is not part of.
+  state.mcycle->write(mcycle);
+  state.mcycle->bump(1);
+  state.minstret->write(minstret);
+  state.minstret->bump(1);
+  state.mip->backdoor_write_with_mask(~reg_t(0), mip);
+
+  const unsigned triggers = checkpoint_read<unsigned>(i);
+  if (triggers != TM.count())
+    throw std::runtime_error("checkpoint has a different number of triggers; was it saved with another --triggers?");
+  for (unsigned t = 0; t < triggers; t++) {
+    TM.tdata1_write(t, checkpoint_read<reg_t>(i));
+    TM.tdata2_write(t, checkpoint_read<reg_t>(i));
+    TM.tdata3_write(t, checkpoint_read<reg_t>(i));
+  }
+
+  if (checkpoint_read<reg_t>(i) != VU.vlenb)
+    throw std::runtime_error("checkpoint has a different VLEN; was it saved with another --varch?");
+  if (!i.read((char*)VU.reg_file, NVPR * VU.vlenb))
+    throw std::runtime_error("checkpoint is truncated");
+  const reg_t vl = checkpoint_read<reg_t>(i);
+  const reg_t vtype = checkpoint_read<reg_t>(i);
+  VU.set_vl(1, 1, vl, vtype);
+  VU.vstart->write_raw(checkpoint_read<reg_t>(i));
+
+  state.prv = state.prev_prv = prv;
+  state.v = state.prev_v = v;
+  state.prv_changed = state.v_changed = false;
+  state.debug_mode = debug_mode;
+
+  mmu->yield_load_reservation();
+  mmu->flush_tlb();
+  mmu->flush_icache();
+}
+
 extension_t* processor_t::get_extension()
 {
   switch (custom_extensions.size()) {
@@ -721,14 +913,17 @@ void processor_t::set_variable_range_check(reg_t *variable, reg_t n, int max_val
 // Initialize the IOPMP configuration variables
 void processor_t::set_md_num(reg_t n) {
     set_variable_range_check(&md_num, n, state.max_mdcfg, "number of memory domains");
+    state.iopmp_index.invalidate();
 }
 
 void processor_t::set_sid_num(reg_t n) {
     set_variable_range_check(&sid_num, n, state.max_srcmd, "number of source ids");
+    state.iopmp_index.invalidate();
 }
 
 void processor_t::set_entry_num(reg_t n) {
     set_variable_range_check(&entry_num, n, state.max_entry_addr, "number of entries");
+    state.iopmp_index.invalidate();
 }
 
 void processor_t::set_mmu_capability(int cap)
@@ -835,7 +1030,7 @@ reg_t processor_t::legalize_privilege(reg_t prv)
 
 void processor_t::set_privilege(reg_t prv, bool virt)
 {
-  mmu->flush_tlb();
+  mmu->switch_tlb_context();
   state.prev_prv = state.prv;
   state.prev_v = state.v;
   state.prv = legalize_privilege(prv);
@@ -1120,6 +1315,7 @@ insn_func_t processor_t::decode_insn(insn_t insn)
   bool rve = extension_enabled('E');
 
   if (unlikely(insn.bits() != desc.match)) {
+    perf.opcode_cache_misses++;
     // fall back to linear search
     auto matching = [insn_bits = insn.bits()](const insn_desc_t &d) {
       return (insn_bits & d.mask) == d.match;
@@ -9,6 +9,7 @@
 #include <vector>
 #include <unordered_map>
 #include <map>
+#include <tuple>
 #include <cassert>
 #include "debug_rom_defines.h"
 #include "entropy_source.h"
@@ -17,6 +18,10 @@
 #include "triggers.h"
 #include "../fesvr/memif.h"
 #include "vector_unit.h"
+#include "iopmp_index.h"
+#include "commit_log.h"
+#include "call_graph.h"
+#include "perf_counters.h"
 
 #define N_HPMCOUNTERS 29
 
@@ -26,6 +31,7 @@ typedef reg_t (*insn_func_t)(processor_t*, insn_t, reg_t);
 class simif_t;
 class trap_t;
 class extension_t;
+class jit_t;
 class disassembler_t;
 
 reg_t illegal_instruction(processor_t* p, insn_t insn, reg_t pc);
@@ -65,11 +71,60 @@ struct insn_desc_t
   }
 };
 
+// The most distinct registers and CSRs one instruction can log a write to
+#define COMMIT_LOG_MAX_REG_WRITES 128
+// The most memory accesses one instruction can log: a whole-register or
+// segment vector access moves 8 registers of up to 4096 bits a byte at a time
+#define COMMIT_LOG_MAX_MEM_ACCESSES (8 * 4096 / 8)
+
 // regnum, data
-typedef std::unordered_map<reg_t, freg_t> commit_log_reg_t;
+// Kept in the order registers are first written; writing a register again
+// only updates its value.  The logged path runs once per instruction, so
+// the log lives in a fixed array rather than a hash table.
+class commit_log_reg_t
+{
+public:
+  typedef std::pair<reg_t, freg_t> value_type;
+
+  freg_t& operator[](reg_t regnum) {
+    for (size_t i = 0; i < n; i++)
+      if (items[i].first == regnum)
+        return items[i].second;
+    if (n == COMMIT_LOG_MAX_REG_WRITES)
+      abort();
+    items[n].first = regnum;
+    return items[n++].second;
+  }
+  void clear() { n = 0; }
+  size_t size() const { return n; }
+  const value_type* begin() const { return items; }
+  const value_type* end() const { return items + n; }
+
+private:
+  size_t n = 0;
+  value_type items[COMMIT_LOG_MAX_REG_WRITES];
+};
 
 // addr, value, size
-typedef std::vector<std::tuple<reg_t, uint64_t, uint8_t>> commit_log_mem_t;
+class commit_log_mem_t
+{
+public:
+  typedef std::tuple<reg_t, uint64_t, uint8_t> value_type;
+
+  void push_back(const value_type& item) {
+    if (n == COMMIT_LOG_MAX_MEM_ACCESSES)
+      abort();
+    items[n++] = item;
+  }
+  void clear() { n = 0; }
+  size_t size() const { return n; }
+  const value_type* begin() const { return items; }
+  const value_type* end() const { return items + n; }
+
+private:
+  size_t n = 0;
+  value_type items[COMMIT_LOG_MAX_MEM_ACCESSES];
+};
 
 // architectural state of a RISC-V hart
 struct state_t
@@ -164,6 +219,7 @@ struct state_t
   mdcfglck_csr_t_p mdcfglck;
   entry_addr_csr_t_p entry_addr[max_entry_addr];
   entrylck_csr_t_p entrylck;
+  iopmp_index_t iopmp_index; // derived from the IOPMP CSRs above
 
   float_csr_t_p fflags;
   float_csr_t_p frm;
@@ -198,6 +254,7 @@ struct state_t
   commit_log_reg_t log_reg_write;
   commit_log_mem_t log_mem_read;
   commit_log_mem_t log_mem_write;
+  std::vector<commit_log_record_t> log_records;
   reg_t last_inst_priv;
   int last_inst_xlen;
   int last_inst_flen;
@@ -217,9 +274,11 @@ public:
 
   void set_debug(bool value);
   void set_histogram(bool value);
-  void enable_log_commits();
+  void enable_log_commits(commit_log_writer_t* writer = NULL);
   bool get_log_commits_enabled() const { return log_commits_enabled; }
   void reset();
+  void save(std::ostream& o) override;
+  void restore(std::istream& i) override;
   void step(size_t n); // run for n cycles
   void put_csr(int which, reg_t val);
   uint32_t get_id() const { return id; }
@@ -289,9 +348,15 @@ public:
   void set_privilege(reg_t, bool);
   const char* get_privilege_string();
   void update_histogram(reg_t pc);
+  // pcs sampled every --profile interval instructions, with their counts
+  const std::unordered_map<reg_t, uint64_t>& get_pc_samples() const { return pc_samples; }
+  // The calling contexts of those samples, with --profile-calls
+  const call_graph_t* get_call_graph() const { return call_graph; }
+  const perf_counters_t& get_perf_counters() const { return perf; }
   const disassembler_t* get_disassembler() { return disassembler; }
 
   FILE *get_log_file() { return log_file; }
+  commit_log_writer_t *get_commit_log_writer() { return commit_log_writer; }
 
   void register_base_insn(insn_desc_t insn) {
     register_insn(insn, false /* is_custom */);
@@ -337,6 +402,8 @@ private:
 
   simif_t* sim;
   mmu_t* mmu; // main memory is always accessed via the mmu
+  jit_t* jit; // compiles hot blocks when --jit is given, otherwise NULL
+  call_graph_t* call_graph; // tracks calls when --profile-calls is given, otherwise NULL
   std::unordered_map<std::string, extension_t*> custom_extensions;
   disassembler_t* disassembler;
   state_t state;
@@ -345,6 +412,7 @@ private:
   bool histogram_enabled;
   bool log_commits_enabled;
   FILE *log_file;
+  commit_log_writer_t *commit_log_writer; // NULL unless --log-commits-binary is given
   std::ostream sout_; // needed for socket command interface -s, also used for -d and -l, but not for --log
   bool halt_on_reset;
   bool in_wfi;
@@ -359,6 +427,9 @@ private:
   std::vector<insn_desc_t> instructions;
   std::vector<insn_desc_t> custom_instructions;
   std::unordered_map<reg_t,uint64_t> pc_histogram;
+  std::unordered_map<reg_t,uint64_t> pc_samples;
+  reg_t profile_countdown; // instructions until the next pc sample, 0 without --profile
+  perf_counters_t perf;
 
   static const size_t OPCODE_CACHE_SIZE = 8191;
   insn_desc_t opcode_cache[OPCODE_CACHE_SIZE];
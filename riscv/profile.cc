@@ -0,0 +1,143 @@
+// See LICENSE for license details.
+
+#include "sim.h"
+#include <algorithm>
+#include <cinttypes>
+#include <map>
+#include <set>
+#include <stdexcept>
+
+// --profile samples the pc of each hart every profile interval instructions,
+// from processor_t::step, so it does not take harts off the fast path.  At
+// exit the samples are written twice:
+//  - to the profile path, as folded stacks, one line per hart and function,
+//    e.g. "core0;memcpy 1234", which flamegraph.pl, speedscope and similar
+//    tools read;
+//  - to the profile path followed by .flat, as a flat profile of pcs, most
+//    sampled first.
+// pcs are resolved against the ELF symbols htif loaded; pcs below every
+// symbol are reported by address.
+//
+// With --profile-calls, each folded stack is the calling context the hart
+// tracked (see call_graph_t), and the samples of each function, with and
+// without those of its callees, are written to the profile path followed by
+// .functions.
+
+static FILE* open_profile(const std::string& path)
+{
+  FILE* f = fopen(path.c_str(), "w");
+  if (!f)
+    throw std::runtime_error("could not create profile " + path);
+  return f;
+}
+
+std::string sim_t::function_name(reg_t pc)
+{
+  reg_t base;
+  if (const char* sym = get_symbol_containing(pc, &base))
+    return sym;
+  char buf[32];
+  snprintf(buf, sizeof(buf), "0x%" PRIx64, pc);
+  return buf;
+}
+
+void sim_t::write_profile()
+{
+  struct pc_sample_t {
+    size_t hart;
+    reg_t pc;
+    uint64_t count;
+  };
+  std::vector<pc_sample_t> samples;
+  uint64_t total = 0;
+  for (auto p : procs) {
+    for (auto& [pc, count] : p->get_pc_samples()) {
+      samples.push_back({p->get_id(), pc, count});
+      total += count;
+    }
+  }
+  std::sort(samples.begin(), samples.end(), [](const pc_sample_t& a, const pc_sample_t& b) {
+    return a.count != b.count ? a.count > b.count : a.hart != b.hart ? a.hart < b.hart : a.pc < b.pc;
+  });
+
+  FILE* flat = open_profile(cfg->profile_path + ".flat");
+  fprintf(flat, "# %" PRIu64 " samples, one every %" PRIu64 " instructions\n", total, *cfg->profile_interval);
+  fprintf(flat, "# %10s %7s %6s %18s  %s\n", "samples", "percent", "hart", "pc", "symbol");
+  for (auto& s : samples) {
+    reg_t base = 0;
+    const char* sym = get_symbol_containing(s.pc, &base);
+    fprintf(flat, "  %10" PRIu64 " %6.2f%% %6zu 0x%016" PRIx64 "  ", s.count, 100.0 * s.count / total, s.hart, s.pc);
+    if (sym)
+      fprintf(flat, "%s+0x%" PRIx64 "\n", sym, s.pc - base);
+    else
+      fprintf(flat, "?\n");
+  }
+  fclose(flat);
+
+  // Each stack is a list of function names, outermost first
+  std::map<std::vector<std::string>, uint64_t> stacks;
+  for (auto p : procs) {
+    const std::vector<std::string> hart = {"core" + std::to_string(p->get_id())};
+    const call_graph_t* graph = p->get_call_graph();
+    if (!graph) {
+      for (auto& [pc, count] : p->get_pc_samples()) {
+        auto stack = hart;
+        stack.push_back(function_name(pc));
+        stacks[stack] += count;
+      }
+      continue;
+    }
+
+    auto& nodes = graph->get_nodes();
+    for (size_t n = 0; n < nodes.size(); n++) {
+      if (nodes[n].samples.empty())
+        continue;
+      std::vector<std::string> context;
+      for (size_t i = n; i != 0; i = nodes[i].parent)
+        context.push_back(function_name(nodes[i].func));
+      context.insert(context.end(), hart.rbegin(), hart.rend());
+      std::reverse(context.begin(), context.end());
+
+      // The sampled pc names the leaf, unless it is in the callee itself
+      for (auto& [pc, count] : nodes[n].samples) {
+        auto stack = context;
+        std::string leaf = function_name(pc);
+        if (leaf != stack.back())
+          stack.push_back(leaf);
+        stacks[stack] += count;
+      }
+    }
+  }
+
+  FILE* folded = open_profile(cfg->profile_path);
+  for (auto& [stack, count] : stacks) {
+    for (size_t i = 0; i < stack.size(); i++)
+      fprintf(folded, "%s%s", i ? ";" : "", stack[i].c_str());
+    fprintf(folded, " %" PRIu64 "\n", count);
+  }
+  fclose(folded);
+
+  if (!cfg->profile_calls)
+    return;
+
+  // A recursive function only counts once towards its inclusive samples
+  std::map<std::string, std::pair<uint64_t, uint64_t>> functions; // inclusive, exclusive
+  for (auto& [stack, count] : stacks) {
+    std::set<std::string> seen(stack.begin() + 1, stack.end());
+    for (auto& f : seen)
+      functions[f].first += count;
+    functions[stack.back()].second += count;
+  }
+  std::vector<std::pair<std::string, std::pair<uint64_t, uint64_t>>> ordered(functions.begin(), functions.end());
+  std::sort(ordered.begin(), ordered.end(), [](auto& a, auto& b) {
+    return a.second.first != b.second.first ? a.second.first > b.second.first : a.first < b.first;
+  });
+
+  FILE* table = open_profile(cfg->profile_path + ".functions");
+  fprintf(table, "# %" PRIu64 " samples, one every %" PRIu64 " instructions\n", total, *cfg->profile_interval);
+  fprintf(table, "# %10s %7s %10s %7s  %s\n", "inclusive", "percent", "exclusive", "percent", "function");
+  for (auto& [name, count] : ordered)
+    fprintf(table, "  %10" PRIu64 " %6.2f%% %10" PRIu64 " %6.2f%%  %s\n",
+            count.first, 100.0 * count.first / total, count.second, 100.0 * count.second / total, name.c_str());
+  fclose(table);
+}
@@ -9,6 +9,7 @@
 #include "platform.h"
 #include "libfdt.h"
 #include "socketif.h"
+#include "hart_threads.h"
 #include <fstream>
 #include <map>
 #include <iostream>
@@ -56,6 +57,7 @@ sim_t::sim_t(const cfg_t *cfg, bool halted,
     sout_(nullptr),
     current_step(0),
     current_proc(0),
+    total_steps(0),
     debug(false),
     histogram_enabled(false),
     log(false),
@@ -66,8 +68,11 @@ sim_t::sim_t(const cfg_t *cfg, bool halted,
 
   sout_.rdbuf(std::cerr.rdbuf()); // debug output goes to stderr by default
 
-  for (auto& x : mems)
+  for (auto& x : mems) {
     bus.add_device(x.first, x.second);
+    if (auto flat = dynamic_cast<flat_mem_t*>(x.second))
+      flat_regions.push_back({x.first, flat->size(), flat->host_base()});
+  }
 
   bus.add_device(DEBUG_START, &debug_module);
 
@@ -102,9 +107,23 @@ sim_t::sim_t(const cfg_t *cfg, bool halted,
     harts[cfg->hartids[i]] = procs[i];
   }
 
+  if (cfg->parallel != parallel_none) {
+    size_t nthreads = cfg->parallel_threads ? cfg->parallel_threads : procs.size();
+    hart_threads.reset(new hart_threads_t(std::min(nthreads, procs.size())));
+    if (cfg->parallel == parallel_relaxed) {
+      for (auto p : procs)
+        p->get_mmu()->set_atomic_lock(&atomic_lock);
+    }
+  }
+
   // Pass first processor to debug mmu, necessary for IOPMP
   debug_mmu = new mmu_t(this, cfg->endianness, NULL, procs[0]);
 
+  if (cfg->perf_interval) {
+    perf_log.reset(new perf_log_t(cfg->perf_path));
+    next_perf_dump = *cfg->perf_interval;
+  }
+
   // When running without using a dtb, skip the fdt-based configuration steps
   if (!dtb_enabled) return;
 
@@ -245,6 +264,7 @@ sim_t::sim_t(const cfg_t *cfg, bool halted,
 
 sim_t::~sim_t()
 {
+  hart_threads.reset();
   for (size_t i = 0; i < procs.size(); i++)
     delete procs[i];
   delete debug_mmu;
@@ -259,15 +279,32 @@ int sim_t::run()
 
   // htif_t::run() will repeatedly call back into sim_t::idle(), each
   // invocation of which will advance target time
-  return htif_t::run();
+  int exit_code = htif_t::run();
+
+  if (cfg->profile_interval)
+    write_profile();
+  if (perf_log)
+    dump_perf_counters();
+
+  return exit_code;
 }
 
 void sim_t::step(size_t n)
 {
+  if (hart_threads && cfg->parallel == parallel_relaxed)
+    return step_relaxed(n);
+
   for (size_t i = 0, steps = 0; i < n; i += steps)
   {
     steps = std::min(n - i, INTERLEAVE - current_step);
-    procs[current_proc]->step(steps);
+    if (hart_threads) {
+      // Deterministic mode: the hart's own thread runs exactly the slice
+      // the sequential scheduler would, while this thread waits.
+      hart_threads->run_on(current_proc % hart_threads->size(),
+                           [&](size_t) { procs[current_proc]->step(steps); });
+    } else {
+      procs[current_proc]->step(steps);
+    }
 
     current_step += steps;
     if (current_step == INTERLEAVE)
@@ -283,6 +320,26 @@ void sim_t::step(size_t n)
   }
 }
 
+// Relaxed mode: every hart runs a full quantum concurrently with the others.
+// The end of the quantum stands in for the end of a sequential round:
+// reservations are yielded and devices tick while all harts are stopped.
+void sim_t::step_relaxed(size_t n)
+{
+  const size_t nthreads = hart_threads->size();
+  for (size_t i = 0; i < n; i += INTERLEAVE * procs.size())
+  {
+    hart_threads->run_all([&](size_t t) {
+      for (size_t p = t; p < procs.size(); p += nthreads)
+        procs[p]->step(INTERLEAVE);
+    });
+
+    for (auto p : procs)
+      p->get_mmu()->yield_load_reservation();
+    reg_t rtc_ticks = INTERLEAVE / INSNS_PER_RTC_TICK;
+    for (auto &dev : devices) dev->tick(rtc_ticks);
+  }
+}
+
 void sim_t::add_device(reg_t addr, std::shared_ptr<abstract_device_t> dev) {
   bus.add_device(addr, dev.get());
   devices.push_back(dev);
@@ -301,15 +358,18 @@ void sim_t::set_histogram(bool value)
   }
 }
 
-void sim_t::configure_log(bool enable_log, bool enable_commitlog)
+void sim_t::configure_log(bool enable_log, bool enable_commitlog, const char* commitlog_path)
 {
   log = enable_log;
 
   if (!enable_commitlog)
     return;
 
+  if (commitlog_path)
+    commit_log_writer.reset(new commit_log_writer_t(commitlog_path));
+
   for (processor_t *proc : procs) {
-    proc->enable_log_commits();
+    proc->enable_log_commits(commit_log_writer.get());
   }
 }
 
@@ -328,6 +388,9 @@ bool sim_t::mmio_load(reg_t paddr, size_t len, uint8_t* bytes)
 {
   if (paddr + len < paddr || !paddr_ok(paddr + len - 1))
     return false;
+  std::unique_lock<std::recursive_mutex> guard(mmio_lock, std::defer_lock);
+  if (cfg->parallel == parallel_relaxed)
+    guard.lock();
   return bus.load(paddr, len, bytes);
 }
 
@@ -335,6 +398,9 @@ bool sim_t::mmio_store(reg_t paddr, size_t len, const uint8_t* bytes)
 {
   if (paddr + len < paddr || !paddr_ok(paddr + len - 1))
     return false;
+  std::unique_lock<std::recursive_mutex> guard(mmio_lock, std::defer_lock);
+  if (cfg->parallel == parallel_relaxed)
+    guard.lock();
   return bus.store(paddr, len, bytes);
 }
 
@@ -386,6 +452,9 @@ void sim_t::set_rom()
 char* sim_t::addr_to_mem(reg_t paddr) {
   if (!paddr_ok(paddr))
     return NULL;
+  for (auto& r : flat_regions)
+    if (paddr - r.base < r.size)
+      return r.host + (paddr - r.base);
   auto desc = bus.find_device(paddr);
   if (auto mem = dynamic_cast<abstract_mem_t*>(desc.second))
     if (paddr - desc.first < mem->size())
@@ -404,6 +473,8 @@ void sim_t::reset()
 {
   if (dtb_enabled)
     set_rom();
+  if (!cfg->restore_path.empty())
+    restore_checkpoint(cfg->restore_path);
 }
 
 void sim_t::idle()
@@ -411,10 +482,23 @@ void sim_t::idle()
   if (done())
     return;
 
-  if (debug || ctrlc_pressed)
+  if (debug || ctrlc_pressed) {
     interactive();
-  else
-    step(INTERLEAVE);
+  } else {
+    size_t n = INTERLEAVE;
+    if (auto next = next_checkpoint())
+      n = std::min<reg_t>(n, *next - total_steps);
+    step(n);
+    total_steps += n;
+    if (cfg->checkpoint_at && *cfg->checkpoint_at == total_steps)
+      save_checkpoint(cfg->checkpoint_path);
+    if (cfg->checkpoint_every && total_steps % *cfg->checkpoint_every == 0)
+      save_checkpoint(cfg->checkpoint_prefix + std::to_string(total_steps) + ".ckpt");
+    if (perf_log && total_steps >= next_perf_dump) {
+      dump_perf_counters();
+      next_perf_dump = (total_steps / *cfg->perf_interval + 1) * *cfg->perf_interval;
+    }
+  }
 
   if (remote_bitbang)
     remote_bitbang->tick();
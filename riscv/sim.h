@@ -7,6 +7,7 @@
 #include "debug_module.h"
 #include "devices.h"
 #include "log_file.h"
+#include "perf_counters.h"
 #include "processor.h"
 #include "simif.h"
 
@@ -15,9 +16,12 @@
 #include <map>
 #include <string>
 #include <memory>
+#include <mutex>
+#include <atomic>
 #include <sys/types.h>
 
 class mmu_t;
+class hart_threads_t;
 class remote_bitbang_t;
 class socketif_t;
 
@@ -44,8 +48,9 @@ public:
   // Configure logging
   //
   // If enable_log is true, an instruction trace will be generated. If
-  // enable_commitlog is true, so will the commit results
-  void configure_log(bool enable_log, bool enable_commitlog);
+  // enable_commitlog is true, so will the commit results, written in binary
+  // to commitlog_path if it is given
+  void configure_log(bool enable_log, bool enable_commitlog, const char* commitlog_path = NULL);
 
   void set_procs_debug(bool value);
   void set_remote_bitbang(remote_bitbang_t* remote_bitbang) {
@@ -69,6 +74,9 @@ private:
   isa_parser_t isa;
   const cfg_t * const cfg;
   std::vector<std::pair<reg_t, abstract_mem_t*>> mems;
+  // flat_mem_t regions, checked by addr_to_mem before the bus
+  struct flat_region_t { reg_t base; reg_t size; char* host; };
+  std::vector<flat_region_t> flat_regions;
   std::vector<processor_t*> procs;
   std::map<size_t, processor_t*> harts;
   std::pair<reg_t, reg_t> initrd_range;
@@ -80,6 +88,9 @@ private:
   std::shared_ptr<plic_t> plic;
   bus_t bus;
   log_file_t log_file;
+  std::unique_ptr<commit_log_writer_t> commit_log_writer;
+  std::unique_ptr<perf_log_t> perf_log; // set by --perf-counters
+  reg_t next_perf_dump;
 
   FILE *cmd_file; // pointer to debug command input file
 
@@ -88,8 +99,17 @@ private:
 
   processor_t* get_core(const std::string& i);
   void step(size_t n); // step through simulation
+  void step_relaxed(size_t n);
   size_t current_step;
   size_t current_proc;
+  reg_t total_steps; // instructions stepped, summed over all harts
+  // Per-memory bitmaps of pages written since last_checkpoint, kept only
+  // for --checkpoint-every
+  std::vector<std::vector<std::atomic<uint64_t>>> dirty_pages;
+  std::string last_checkpoint;
+  std::unique_ptr<hart_threads_t> hart_threads; // set by --parallel
+  std::recursive_mutex mmio_lock; // serializes MMIO from concurrent hart threads
+  std::mutex atomic_lock; // serializes AMOs and SCs from concurrent hart threads
   bool debug;
   bool histogram_enabled; // provide a histogram of PCs
   bool log;
@@ -101,6 +121,16 @@ private:
   virtual bool mmio_load(reg_t paddr, size_t len, uint8_t* bytes) override;
   virtual bool mmio_store(reg_t paddr, size_t len, const uint8_t* bytes) override;
   void set_rom();
+  std::optional<reg_t> next_checkpoint() const;
+  void save_checkpoint(const std::string& path);
+  void write_profile();
+  std::string function_name(reg_t pc);
+  perf_values_t perf_values(processor_t* p);
+  void dump_perf_counters();
+  void restore_checkpoint(const std::string& path);
+  void restore_checkpoint_memory(const std::string& path);
+  void track_dirty_pages();
+  virtual void mem_written(reg_t paddr) override;
 
   virtual const char* get_symbol(uint64_t paddr) override;
 
@@ -0,0 +1,48 @@
+// See LICENSE for license details.
+
+// This little program reads a commit log written by
+//   spike --log-commits-binary=<path>
+// and prints it as the text spike --log-commits would have printed.
+
+#include "config.h"
+#include "commit_log.h"
+#include <cstdio>
+#include <vector>
+
+int main(int argc, char** argv)
+{
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s <commit log>\n", argv[0]);
+    return 1;
+  }
+
+  bool piped;
+  FILE* file = commit_log_open(argv[1], &piped);
+  if (!file) {
+    fprintf(stderr, "%s: %s is not a spike commit log\n", argv[0], argv[1]);
+    return 1;
+  }
+
+  // Each instruction's records run up to the next COMMIT_LOG_INSN record
+  std::vector<commit_log_record_t> insn;
+  commit_log_record_t buf[4096];
+  size_t n;
+  while ((n = fread(buf, sizeof(buf[0]), sizeof(buf) / sizeof(buf[0]), file)) > 0) {
+    for (size_t i = 0; i < n; i++) {
+      if (buf[i].type == COMMIT_LOG_INSN && !insn.empty()) {
+        commit_log_print(stdout, insn.data(), insn.size());
+        insn.clear();
+      }
+      insn.push_back(buf[i]);
+    }
+  }
+  if (!insn.empty())
+    commit_log_print(stdout, insn.data(), insn.size());
+
+  int status = piped ? pclose(file) : fclose(file);
+  if (status != 0) {
+    fprintf(stderr, "%s: could not read %s\n", argv[0], argv[1]);
+    return 1;
+  }
+  return 0;
+}
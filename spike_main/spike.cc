@@ -4,6 +4,7 @@
 #include "cfg.h"
 #include "sim.h"
 #include "mmu.h"
+#include "jit.h"
 #include "arith.h"
 #include "remote_bitbang.h"
 #include "cachesim.h"
@@ -32,6 +33,11 @@ static void help(int exit_code = 1)
   fprintf(stderr, "  -m<n>                 Provide <n> MiB of target memory [default 2048]\n");
   fprintf(stderr, "  -m<a:m,b:n,...>       Provide memory regions of size m and n bytes\n");
   fprintf(stderr, "                          at base addresses a and b (with 4 KiB alignment)\n");
+  fprintf(stderr, "  -m<a:m@[shared:]f,...> Map the region at a from file f, or from POSIX shared\n");
+  fprintf(stderr, "                          memory object n if f is shm:<n>; copy-on-write unless\n");
+  fprintf(stderr, "                          shared: is given, in which case stores reach f\n");
+  fprintf(stderr, "  --sparse-mem          Allocate target memory page by page on demand rather\n");
+  fprintf(stderr, "                          than reserving host address space up front\n");
   fprintf(stderr, "  -d                    Interactive debug mode\n");
   fprintf(stderr, "  -g                    Track histogram of PCs\n");
   fprintf(stderr, "  -l                    Generate a log of execution\n");
@@ -49,6 +55,7 @@ static void help(int exit_code = 1)
   fprintf(stderr, "  --source-ids=<n>      Number of transaction sources [default 16]\n");
   fprintf(stderr, "  --entry-num=<n>       Length of the entry array [default 16]\n");
   fprintf(stderr, "  --run-iopmp-tests     Runs the IOPMP unit tests\n");
+  fprintf(stderr, "  --run-iopmp-bench     Runs the IOPMP benchmarks\n");
   fprintf(stderr, "  --priv=<m|mu|msu>     RISC-V privilege modes supported [default %s]\n", DEFAULT_PRIV);
   fprintf(stderr, "  --varch=<name>        RISC-V Vector uArch string [default %s]\n", DEFAULT_VARCH);
   fprintf(stderr, "  --pc=<address>        Override ELF entry point\n");
@@ -62,6 +69,10 @@ static void help(int exit_code = 1)
   fprintf(stderr, "                          specify --device=<name>,<args> to pass down extra args.\n");
   fprintf(stderr, "  --log-cache-miss      Generate a log of cache miss\n");
   fprintf(stderr, "  --log-commits         Generate a log of commits info\n");
+  fprintf(stderr, "  --log-commits-binary=<path>\n");
+  fprintf(stderr, "                        Write the log of commits info to <path> in binary, to be\n");
+  fprintf(stderr, "                          decoded by spike-log-decode; compressed if <path> ends\n");
+  fprintf(stderr, "                          in .zst, .lz4 or .gz\n");
   fprintf(stderr, "  --extension=<name>    Specify RoCC Extension\n");
   fprintf(stderr, "                          This flag can be used multiple times.\n");
   fprintf(stderr, "  --extlib=<name>       Shared library to load\n");
@@ -76,6 +87,37 @@ static void help(int exit_code = 1)
           DEFAULT_KERNEL_BOOTARGS);
   fprintf(stderr, "  --real-time-clint     Increment clint time at real-time rate\n");
   fprintf(stderr, "  --triggers=<n>        Number of supported triggers [default 4]\n");
+  fprintf(stderr, "  --jit                 Compile hot integer code to host code (x86-64 hosts)\n");
+  fprintf(stderr, "  --parallel=<mode>[:<n>]\n");
+  fprintf(stderr, "                        Run harts on <n> host threads [default one per hart],\n");
+  fprintf(stderr, "                          either 'deterministic' (same schedule as one thread)\n");
+  fprintf(stderr, "                          or 'relaxed' (harts run concurrently)\n");
+  fprintf(stderr, "  --tlb=<entries>:<ways>[:<policy>]\n");
+  fprintf(stderr, "                        Software TLB geometry, with 'lru' or 'random'\n");
+  fprintf(stderr, "                          replacement [default 256:1:lru]\n");
+  fprintf(stderr, "  --tlb-stats           Print TLB hit and miss counts on exit\n");
+  fprintf(stderr, "  --checkpoint-at=<n>[:<file>]\n");
+  fprintf(stderr, "                        Save a checkpoint to <file> [default spike-<n>.ckpt]\n");
+  fprintf(stderr, "                          once <n> instructions have run on all harts\n");
+  fprintf(stderr, "  --checkpoint-every=<n>[:<prefix>]\n");
+  fprintf(stderr, "                        Every <n> instructions, save a checkpoint to\n");
+  fprintf(stderr, "                          <prefix><instructions so far>.ckpt [default spike-];\n");
+  fprintf(stderr, "                          all but the first hold only the pages written\n");
+  fprintf(stderr, "                          since the one before\n");
+  fprintf(stderr, "  --restore=<file>      Resume from a checkpoint; the other options and the\n");
+  fprintf(stderr, "                          target program must match those it was saved with\n");
+  fprintf(stderr, "  --profile=<n>[:<file>]\n");
+  fprintf(stderr, "                        Sample the pc of each hart every <n> instructions and\n");
+  fprintf(stderr, "                          write folded stacks to <file> [default spike.prof]\n");
+  fprintf(stderr, "                          and a flat profile to <file>.flat\n");
+  fprintf(stderr, "  --profile-calls       Follow calls and returns, so that --profile writes\n");
+  fprintf(stderr, "                          whole calling contexts, and the inclusive and\n");
+  fprintf(stderr, "                          exclusive samples of functions to <file>.functions\n");
+  fprintf(stderr, "  --perf-counters=<n>[:<file>]\n");
+  fprintf(stderr, "                        Write the growth of each hart's simulator event\n");
+  fprintf(stderr, "                          counters every <n> instructions to <file>, as CSV,\n");
+  fprintf(stderr, "                          or as JSON Lines if it ends in .json\n");
+  fprintf(stderr, "                          [default spike-perf.csv]\n");
   fprintf(stderr, "  --dm-progsize=<words> Progsize for the debug module [default 2]\n");
   fprintf(stderr, "  --dm-sba=<bits>       Debug system bus access supports up to "
       "<bits> wide accesses [default 0]\n");
@@ -153,6 +195,11 @@ static mem_cfg_t merge_mem_regions(const mem_cfg_t& L, const mem_cfg_t& R)
   // one can merge only intersecting regions
   assert(check_mem_overlap(L, R));
 
+  if (!L.get_backing().empty() || !R.get_backing().empty()) {
+    fprintf(stderr, "File-backed memory regions may not overlap other memory regions\n");
+    exit(EXIT_FAILURE);
+  }
+
   const auto merged_base = std::min(L.get_base(), R.get_base());
   const auto merged_end_incl = std::max(L.get_inclusive_end(), R.get_inclusive_end());
   const auto merged_size = merged_end_incl - merged_base + 1;
@@ -197,18 +244,42 @@ merge_overlapping_memory_regions(std::vector<mem_cfg_t> mems)
   return merged_mem;
 }
 
+// parse an optional @[shared:]<file> suffix of a memory region
+static void parse_mem_backing(const char** p, std::string* backing, bool* shared)
+{
+  if (**p != '@')
+    return;
+  const char* start = *p + 1;
+  const char* end = strchr(start, ',');
+  if (!end)
+    end = start + strlen(start);
+  *backing = std::string(start, end);
+  *shared = backing->compare(0, 7, "shared:") == 0;
+  if (*shared)
+    backing->erase(0, 7);
+  if (backing->empty())
+    help();
+  *p = end;
+}
+
 static std::vector<mem_cfg_t> parse_mem_layout(const char* arg)
 {
   std::vector<mem_cfg_t> res;
+  std::string backing;
+  bool shared = false;
 
   // handle legacy mem argument
   char* p;
   auto mb = strtoull(arg, &p, 0);
-  if (*p == 0) {
+  if (*p == 0 || *p == '@') {
     reg_t size = reg_t(mb) << 20;
     if (size != (size_t)size)
       throw std::runtime_error("Size would overflow size_t");
-    res.push_back(mem_cfg_t(reg_t(DRAM_BASE), size));
+    const char* q = p;
+    parse_mem_backing(&q, &backing, &shared);
+    if (*q)
+      help();
+    res.push_back(mem_cfg_t(reg_t(DRAM_BASE), size, backing, shared));
     return res;
   }
 
@@ -218,6 +289,11 @@ static std::vector<mem_cfg_t> parse_mem_layout(const char* arg)
     if (!*p || *p != ':')
       help();
     auto size = strtoull(p + 1, &p, 0);
+    backing.clear();
+    shared = false;
+    const char* q = p;
+    parse_mem_backing(&q, &backing, &shared);
+    p = const_cast<char*>(q);
 
     // page-align base and size
     auto base0 = base, size0 = size;
@@ -241,7 +317,7 @@ static std::vector<mem_cfg_t> parse_mem_layout(const char* arg)
 
     const unsigned long long max_allowed_pa = (1ull << MAX_PADDR_BITS) - 1ull;
     assert(max_allowed_pa <= std::numeric_limits<reg_t>::max());
-    mem_cfg_t mem_region(base, size);
+    mem_cfg_t mem_region(base, size, backing, shared);
     if (mem_region.get_inclusive_end() > max_allowed_pa) {
       int bits_required = 64 - clz(mem_region.get_inclusive_end());
       fprintf(stderr, "Unsupported memory region "
@@ -269,16 +345,80 @@ static std::vector<mem_cfg_t> parse_mem_layout(const char* arg)
   return merged_mem;
 }
 
-static std::vector<std::pair<reg_t, abstract_mem_t*>> make_mems(const std::vector<mem_cfg_t> &layout)
+static std::vector<std::pair<reg_t, abstract_mem_t*>> make_mems(const std::vector<mem_cfg_t> &layout,
+                                                                bool sparse)
 {
   std::vector<std::pair<reg_t, abstract_mem_t*>> mems;
   mems.reserve(layout.size());
   for (const auto &cfg : layout) {
-    mems.push_back(std::make_pair(cfg.get_base(), new mem_t(cfg.get_size())));
+    abstract_mem_t* mem;
+    if (!cfg.get_backing().empty())
+      mem = new flat_mem_t(cfg.get_size(), cfg.get_backing(), cfg.is_shared());
+    else if (sparse)
+      mem = new mem_t(cfg.get_size());
+    else
+      mem = new flat_mem_t(cfg.get_size());
+    mems.push_back(std::make_pair(cfg.get_base(), mem));
   }
   return mems;
 }
 
+static void parse_checkpoint_at(const char* s, cfg_t* cfg)
+{
+  char* end;
+  cfg->checkpoint_at = strtoull(s, &end, 0);
+  if (*end == ':' && end[1])
+    cfg->checkpoint_path = end + 1;
+  else if (*end == 0)
+    cfg->checkpoint_path = "spike-" + std::to_string(*cfg->checkpoint_at) + ".ckpt";
+  else {
+    fprintf(stderr, "--checkpoint-at expects <n>[:<file>]\n");
+    exit(1);
+  }
+}
+
+static void parse_checkpoint_every(const char* s, cfg_t* cfg)
+{
+  char* end;
+  cfg->checkpoint_every = strtoull(s, &end, 0);
+  if (*end == ':' && end[1])
+    cfg->checkpoint_prefix = end + 1;
+  else if (*end == 0)
+    cfg->checkpoint_prefix = "spike-";
+  if (*cfg->checkpoint_every == 0 || cfg->checkpoint_prefix.empty()) {
+    fprintf(stderr, "--checkpoint-every expects <n>[:<prefix>] with <n> > 0\n");
+    exit(1);
+  }
+}
+
+static void parse_profile(const char* s, cfg_t* cfg)
+{
+  char* end;
+  cfg->profile_interval = strtoull(s, &end, 0);
+  if (*end == ':' && end[1])
+    cfg->profile_path = end + 1;
+  else if (*end == 0)
+    cfg->profile_path = "spike.prof";
+  if (*cfg->profile_interval == 0 || cfg->profile_path.empty()) {
+    fprintf(stderr, "--profile expects <n>[:<file>] with <n> > 0\n");
+    exit(1);
+  }
+}
+
+static void parse_perf_counters(const char* s, cfg_t* cfg)
+{
+  char* end;
+  cfg->perf_interval = strtoull(s, &end, 0);
+  if (*end == ':' && end[1])
+    cfg->perf_path = end + 1;
+  else if (*end == 0)
+    cfg->perf_path = "spike-perf.csv";
+  if (*cfg->perf_interval == 0 || cfg->perf_path.empty()) {
+    fprintf(stderr, "--perf-counters expects <n>[:<file>] with <n> > 0\n");
+    exit(1);
+  }
+}
+
 static unsigned long atoul_safe(const char* s)
 {
   char* e;
@@ -296,6 +436,63 @@ static unsigned long atoul_nonzero_safe(const char* s)
   return res;
 }
 
+static void parse_parallel(const char* s, cfg_t* cfg)
+{
+  std::string const str(s);
+  std::string const mode = str.substr(0, str.find(':'));
+
+  if (mode == "deterministic")
+    cfg->parallel = parallel_deterministic;
+  else if (mode == "relaxed")
+    cfg->parallel = parallel_relaxed;
+  else {
+    fprintf(stderr, "--parallel mode must be 'deterministic' or 'relaxed'\n");
+    exit(-1);
+  }
+
+  if (mode.size() != str.size()) {
+    char* end;
+    cfg->parallel_threads = strtoul(str.c_str() + mode.size() + 1, &end, 0);
+    if (*end || cfg->parallel_threads == 0) {
+      fprintf(stderr, "--parallel thread count must be a positive integer\n");
+      exit(-1);
+    }
+  }
+}
+
+static void parse_tlb(const char* s, cfg_t* cfg)
+{
+  std::string const str(s);
+  std::stringstream stream(str);
+  std::string entries, ways, policy;
+
+  if (!std::getline(stream, entries, ':') || !std::getline(stream, ways, ':'))
+    help();
+  std::getline(stream, policy);
+
+  char* end;
+  cfg->tlb_entries = strtoul(entries.c_str(), &end, 0);
+  if (*end || cfg->tlb_entries == 0 || (cfg->tlb_entries & (cfg->tlb_entries - 1))) {
+    fprintf(stderr, "--tlb entry count must be a power of 2\n");
+    exit(-1);
+  }
+  cfg->tlb_ways = strtoul(ways.c_str(), &end, 0);
+  if (*end || cfg->tlb_ways == 0 || (cfg->tlb_ways & (cfg->tlb_ways - 1)) ||
+      cfg->tlb_ways > cfg->tlb_entries) {
+    fprintf(stderr, "--tlb way count must be a power of 2 no larger than the entry count\n");
+    exit(-1);
+  }
+
+  if (policy.empty() || policy == "lru")
+    cfg->tlb_policy = tlb_policy_lru;
+  else if (policy == "random")
+    cfg->tlb_policy = tlb_policy_random;
+  else {
+    fprintf(stderr, "--tlb replacement policy must be 'lru' or 'random'\n");
+    exit(-1);
+  }
+}
+
 static std::vector<size_t> parse_hartids(const char *s)
 {
   std::string const str(s);
@@ -339,6 +536,7 @@ int main(int argc, char** argv)
   bool dump_dts = false;
   bool dtb_enabled = true;
   bool run_iopmp_tests = false;
+  bool run_iopmp_bench = false;
   const char* kernel = NULL;
   reg_t kernel_offset, kernel_size;
   std::vector<device_factory_t*> plugin_device_factories;
@@ -347,12 +545,14 @@ int main(int argc, char** argv)
   std::unique_ptr<cache_sim_t> l2;
   bool log_cache = false;
   bool log_commits = false;
+  const char *commit_log_path = nullptr;
   const char *log_path = nullptr;
   std::vector<std::function<extension_t*()>> extensions;
   const char* initrd = NULL;
   const char* dtb_file = NULL;
   uint16_t rbb_port = 0;
   bool use_rbb = false;
+  bool sparse_mem = false;
   unsigned dmi_rti = 0;
   reg_t blocksz = 64;
   debug_module_config_t dm_config;
@@ -414,6 +614,7 @@ int main(int argc, char** argv)
   parser.option(0, "source-ids", 1, [&](const char* s){cfg.sourceids = atoul_safe(s);});
   parser.option(0, "entry-num", 1, [&](const char* s){cfg.entrynum = atoul_safe(s);});
   parser.option(0, "run-iopmp-tests", 0, [&](const char UNUSED *s){run_iopmp_tests = true;});
+  parser.option(0, "run-iopmp-bench", 0, [&](const char UNUSED *s){run_iopmp_bench = true;});
   parser.option(0, "priv", 1, [&](const char* s){cfg.priv = s;});
   parser.option(0, "varch", 1, [&](const char* s){cfg.varch = s;});
   parser.option(0, "device", 1, device_parser);
@@ -426,6 +627,23 @@ int main(int argc, char** argv)
   parser.option(0, "bootargs", 1, [&](const char* s){cfg.bootargs = s;});
   parser.option(0, "real-time-clint", 0, [&](const char UNUSED *s){cfg.real_time_clint = true;});
   parser.option(0, "triggers", 1, [&](const char *s){cfg.trigger_count = atoul_safe(s);});
+  parser.option(0, "jit", 0, [&](const char UNUSED *s){
+    if (!jit_t::host_supported()) {
+      fprintf(stderr, "--jit is only supported on x86-64 hosts\n");
+      exit(1);
+    }
+    cfg.jit = true;
+  });
+  parser.option(0, "parallel", 1, [&](const char *s){parse_parallel(s, &cfg);});
+  parser.option(0, "tlb", 1, [&](const char *s){parse_tlb(s, &cfg);});
+  parser.option(0, "tlb-stats", 0, [&](const char UNUSED *s){cfg.tlb_stats = true;});
+  parser.option(0, "sparse-mem", 0, [&](const char UNUSED *s){sparse_mem = true;});
+  parser.option(0, "checkpoint-at", 1, [&](const char *s){parse_checkpoint_at(s, &cfg);});
+  parser.option(0, "checkpoint-every", 1, [&](const char *s){parse_checkpoint_every(s, &cfg);});
+  parser.option(0, "profile", 1, [&](const char *s){parse_profile(s, &cfg);});
+  parser.option(0, "profile-calls", 0, [&](const char UNUSED *s){cfg.profile_calls = true;});
+  parser.option(0, "perf-counters", 1, [&](const char *s){parse_perf_counters(s, &cfg);});
+  parser.option(0, "restore", 1, [&](const char *s){cfg.restore_path = s;});
   parser.option(0, "extlib", 1, [&](const char *s){
     void *lib = dlopen(s, RTLD_NOW | RTLD_GLOBAL);
     if (lib == NULL) {
@@ -455,6 +673,8 @@ int main(int argc, char** argv)
       [&](const char UNUSED *s){dm_config.support_haltgroups = false;});
   parser.option(0, "log-commits", 0,
                 [&](const char UNUSED *s){log_commits = true;});
+  parser.option(0, "log-commits-binary", 1,
+                [&](const char* s){log_commits = true; commit_log_path = s;});
   parser.option(0, "log", 1,
                 [&](const char* s){log_path = s;});
   FILE *cmd_file = NULL;
@@ -482,11 +702,25 @@ int main(int argc, char** argv)
     iopmp_tests_main();
   }
 
+  if (run_iopmp_bench) {
+    iopmp_bench_main();
+  }
+
   if (!*argv1)
     help();
 
+  if (cfg.parallel == parallel_relaxed && (debug || log || log_commits || ic || dc || l2)) {
+    fprintf(stderr, "--parallel=relaxed cannot be combined with -d, -l, --log-commits or cache models\n");
+    exit(1);
+  }
+
+  if (cfg.profile_calls && !cfg.profile_interval) {
+    fprintf(stderr, "--profile-calls requires --profile\n");
+    exit(1);
+  }
+
   std::vector<std::pair<reg_t, abstract_mem_t*>> mems =
-      make_mems(cfg.mem_layout);
+      make_mems(cfg.mem_layout, sparse_mem);
 
   if (kernel && check_file_exists(kernel)) {
     const char *isa = cfg.isa;
@@ -567,7 +801,7 @@ int main(int argc, char** argv)
   }
 
   s.set_debug(debug);
-  s.configure_log(log, log_commits);
+  s.configure_log(log, log_commits, commit_log_path);
   s.set_histogram(histogram);
 
   auto return_code = s.run();